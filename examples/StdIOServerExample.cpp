@@ -80,6 +80,7 @@ public:
                                 }
                                 return rsp;
                         });
+                remote_end_point_.freeze();
 
                 remote_end_point_.startProcessingMessages(input, output);
         }
@@ -93,6 +93,7 @@ public:
                         {
                                 std::cout << notify.ToJson() << std::endl;
                         });
+                server.point.freeze();
                 std::thread([&]()
                         {
                                 server.run();
@@ -250,6 +250,7 @@ public:
                 rsp.result.capabilities.codeLensProvider = code_lens_options;
                 return rsp;
                 });
+        server.point.freeze();
         std::thread([&]()
             {
                 server.run();
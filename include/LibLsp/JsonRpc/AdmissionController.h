@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "LibLsp/JsonRpc/MethodTable.h"
+
+namespace lsp
+{
+        // Estimates how long a message arriving now would wait for a worker,
+        // from a moving average of recent handler times per method, so that
+        // low priority requests can be turned away while the wait is over a
+        // latency budget. Thread-safe once Reserve() has been called.
+        class AdmissionController
+        {
+        public:
+                explicit AdmissionController(unsigned workers);
+                ~AdmissionController();
+                AdmissionController(const AdmissionController&) = delete;
+                AdmissionController& operator=(const AdmissionController&) = delete;
+
+                // Makes room for an average per method interned so far. Later
+                // methods share the average over all methods. Only the first call
+                // has an effect; make it before messages flow.
+                void Reserve(size_t method_count);
+
+                // 0, the default, admits everything.
+                void SetBudget(std::chrono::milliseconds budget);
+                std::chrono::milliseconds GetBudget() const;
+
+                // Bracket one handler run; |expected| is what Started() returned.
+                int64_t Started(MethodId method);
+                void Finished(MethodId method, int64_t expected, std::chrono::steady_clock::duration took);
+
+                // With |queued| messages waiting for a worker.
+                std::chrono::microseconds EstimatedWait(size_t queued) const;
+                bool OverBudget(size_t queued) const;
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
@@ -3,6 +3,7 @@
 #include <functional>
 #include <memory>
 #include "MessageIssue.h"
+#include "MethodTable.h"
 struct LspMessage;
 struct NotificationInMessage;
 struct lsBaseOutMessage;
@@ -33,9 +34,10 @@ public:
         bool onResponse(const std::string&, std::unique_ptr<LspMessage>) override;
 
         bool onRequest(std::unique_ptr<LspMessage>) override;
-        std::map< std::string, GenericRequestHandler > method2request;
-        std::map< std::string, GenericResponseHandler  > method2response;
-        std::map< std::string, GenericNotificationHandler  > method2notification;
+        // Indexed by MethodId; see MessageJsonHandler.
+        lsp::MethodSlots< GenericRequestHandler > method2request;
+        lsp::MethodSlots< GenericResponseHandler > method2response;
+        lsp::MethodSlots< GenericNotificationHandler > method2notification;
 
           void registerRequestHandler(const std::string& method, GenericResponseHandler cb) override
         {
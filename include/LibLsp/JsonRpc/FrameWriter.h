@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace lsp
+{
+        class ostream;
+
+        // Writes complete frames to a stream from a thread of its own. Any
+        // number of threads push frames onto a lock-free queue; the writer
+        // thread hands everything that has queued up to the stream in one
+        // gather write and one flush, or in one write per frame if the stream
+        // is message-oriented. A push blocks while more than |max_queued_bytes|
+        // are waiting, so a client that stops reading holds up the threads
+        // producing output instead of growing the queue without bound. Queued
+        // bytes are reported to MemoryBudget::Global().
+        class FrameWriter
+        {
+        public:
+                static constexpr size_t kDefaultMaxQueuedBytes = 16 * 1024 * 1024;
+
+                explicit FrameWriter(size_t max_queued_bytes = kDefaultMaxQueuedBytes);
+                // Stops, writing what is still queued.
+                ~FrameWriter();
+                FrameWriter(const FrameWriter&) = delete;
+                FrameWriter& operator=(const FrameWriter&) = delete;
+
+                // Starts the writer thread on |output|. Pushes fail until then.
+                void Start(std::shared_ptr<ostream> output);
+                // Writes what is queued and joins the writer thread. Blocked and
+                // later pushes fail until the next Start().
+                void Stop();
+
+                // Queues |frame| to be written as is. Returns false if the writer
+                // is stopped or the stream has gone bad.
+                bool Push(std::string&& frame);
+
+                void SetMaxQueuedBytes(size_t bytes);
+                size_t queued_bytes() const;
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
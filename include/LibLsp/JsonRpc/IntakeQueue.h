@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace lsp
+{
+        // What the reader does with a message that does not fit in the intake
+        // queue.
+        enum class IntakeOverflow
+        {
+                // Wait for room. The transport is not read meanwhile, so a
+                // client that keeps sending is held back by flow control.
+                Block,
+                // Answer low priority requests with ServerCancelled and drop low
+                // priority notifications; wait for room for anything else.
+                ShedLowPriority
+        };
+
+        // Messages read from the transport and not yet picked up by a worker.
+        // Bounded by a message count and a byte count, whichever is reached
+        // first; a single message larger than the byte limit is still taken
+        // once the queue is empty. Publishes <name>.depth and <name>.bytes
+        // gauges and a <name>.blocked counter to Metrics::Global(), and its
+        // bytes to MemoryBudget::Global(); a second queue with the same name
+        // publishes under <name>.2 and so on. Thread-safe.
+        class IntakeQueue
+        {
+        public:
+                struct Limits
+                {
+                        size_t max_messages = 1024;
+                        size_t max_bytes = 64 * 1024 * 1024;
+                };
+
+                explicit IntakeQueue(const std::string& name = "intake");
+                ~IntakeQueue();
+                IntakeQueue(const IntakeQueue&) = delete;
+                IntakeQueue& operator=(const IntakeQueue&) = delete;
+
+                // Blocks until |message| fits. Returns false, dropping it, if the
+                // queue is closed.
+                bool Push(std::string&& message);
+                // Takes |message| only if it fits right away.
+                bool TryPush(std::string& message);
+                // Never blocks. Returns false if the queue is empty.
+                bool TryPop(std::string& message);
+
+                // Drops what is queued and makes every push fail, including those
+                // waiting for room, until Open().
+                void Close();
+                void Open();
+
+                void SetLimits(const Limits& limits);
+                Limits GetLimits() const;
+                size_t depth() const;
+                size_t bytes() const;
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
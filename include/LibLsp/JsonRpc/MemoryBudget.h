@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lsp
+{
+        class Metrics;
+
+        // Process-wide account of the memory held by caches, document buffers and
+        // queues. Owners register, report their usage as it changes, and may offer
+        // a trim callback. When the total goes over the limit the largest
+        // trimmable owners are asked, off the reporting thread, to release memory
+        // until usage is back under 90% of the limit.
+        class MemoryBudget
+        {
+        public:
+                // Asked to release about |bytes|; returns how much it released. It
+                // runs on a TimerWheel::Default() worker, never on the thread that
+                // reported, and may report its new usage.
+                using TrimCallback = std::function<size_t(size_t bytes)>;
+
+                // Held by a registered owner; destroying it drops its usage. Do not
+                // destroy it while holding a lock that the trim callback takes.
+                class Consumer
+                {
+                public:
+                        ~Consumer();
+                        Consumer(const Consumer&) = delete;
+                        Consumer& operator=(const Consumer&) = delete;
+
+                        void Set(size_t bytes);
+                        void Add(int64_t delta);
+                        size_t bytes() const;
+                        // The registered name, made unique; see Register().
+                        const std::string& name() const { return name_; }
+
+                private:
+                        friend class MemoryBudget;
+                        Consumer(MemoryBudget& budget, uint64_t id, std::string name,
+                                std::shared_ptr<std::atomic<size_t>> usage);
+
+                        MemoryBudget& budget_;
+                        uint64_t id_;
+                        std::string name_;
+                        std::shared_ptr<std::atomic<size_t>> usage_;
+                };
+
+                // Publishes its totals to Metrics::Global(); unlimited until
+                // SetLimit() is called. Never destroyed.
+                static MemoryBudget& Global();
+
+                // Totals are published as memory.* gauges when |metrics| is set.
+                explicit MemoryBudget(Metrics* metrics = nullptr);
+                // Every Consumer must be destroyed first.
+                ~MemoryBudget();
+                MemoryBudget(const MemoryBudget&) = delete;
+                MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+                // The second and later consumers registered under the same |name|
+                // are named <name>.2, <name>.3 and so on, so that their gauges
+                // can be told apart.
+                std::unique_ptr<Consumer> Register(const std::string& name, TrimCallback trim = nullptr);
+
+                // 0 disables the limit.
+                void SetLimit(size_t bytes);
+                size_t GetLimit() const;
+                size_t Total() const;
+
+                // Asks trimmable consumers, largest first, to release memory until
+                // the total is at most |target|. Returns the bytes released.
+                size_t Reclaim(size_t target);
+
+                // Usage of every consumer, largest first.
+                std::vector<std::pair<std::string, size_t>> Usage() const;
+
+        private:
+                void Update(int64_t delta);
+                void CheckPressure();
+                void Unregister(uint64_t id);
+
+                struct Data;
+                Data* d_ptr;
+        };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include <rapidjson/document.h>
+
+namespace lsp
+{
+        // DOM of one incoming message. Values and the parse stack both come from
+        // memory pools, so nothing in it is freed piecemeal.
+        using MessageDocument = rapidjson::GenericDocument<rapidjson::UTF8<>,
+                rapidjson::MemoryPoolAllocator<>, rapidjson::MemoryPoolAllocator<>>;
+
+        // Scratch memory for parsing one message. The pools start in buffers that
+        // belong to the calling thread and are reused for its next message, so in
+        // the steady state parsing does not touch the heap. A message that does
+        // not fit spills into chunks that are released with the arena in one go,
+        // and the thread's buffer grows to fit the next one, up to a cap.
+        //
+        // Nothing may keep pointers into the document once the arena is gone;
+        // deserialized messages copy what they need.
+        class MessageArena
+        {
+        public:
+                MessageArena();
+                ~MessageArena();
+                MessageArena(const MessageArena&) = delete;
+                MessageArena& operator=(const MessageArena&) = delete;
+
+                MessageDocument& document() { return document_; }
+
+                // Bytes handed out for values so far.
+                size_t used() const { return values_.Size(); }
+
+        private:
+                using Pool = rapidjson::MemoryPoolAllocator<>;
+
+                struct Buffers;
+                // Declared first so the buffers outlive the pools that point
+                // into them.
+                struct Lease
+                {
+                        Lease();
+                        ~Lease();
+                        Buffers* buffers = nullptr;
+                        // Set when the thread's buffers were already taken, by
+                        // a message dispatched from inside another one.
+                        std::unique_ptr<Buffers> own;
+                        size_t used = 0;
+                };
+
+                Lease lease_;
+                Pool values_;
+                Pool stack_;
+                MessageDocument document_;
+        };
+}
@@ -1,8 +1,8 @@
 #pragma once
 #include <string>
-#include <map>
 #include <functional>
 #include <LibLsp/JsonRpc/message.h>
+#include "LibLsp/JsonRpc/MethodTable.h"
 class Reader;
 
 
@@ -13,15 +13,16 @@ using  GenericNotificationJsonHandler = std::function< std::unique_ptr<LspMessag
 class MessageJsonHandler
 {
 public:
-        std::map< std::string, GenericRequestJsonHandler > method2request;
-        std::map< std::string,  GenericResponseJsonHandler > method2response;
-        std::map< std::string, GenericNotificationJsonHandler > method2notification;
+        // Indexed by MethodId, so a parser is found with one perfect-hash
+        // lookup of the method name, or none when the id is already known.
+        lsp::MethodSlots< GenericRequestJsonHandler > method2request;
+        lsp::MethodSlots< GenericResponseJsonHandler > method2response;
+        lsp::MethodSlots< GenericNotificationJsonHandler > method2notification;
 
 
         const GenericRequestJsonHandler* GetRequestJsonHandler(const char* methodInfo) const
         {
-                const auto findIt = method2request.find(methodInfo);
-                return  findIt == method2request.end() ? nullptr : &findIt->second;
+                return method2request.Find(methodInfo);
         }
 
         void SetRequestJsonHandler(const std::string& methodInfo, GenericRequestJsonHandler handler)
@@ -31,8 +32,7 @@ public:
 
         const GenericResponseJsonHandler* GetResponseJsonHandler(const char* methodInfo) const
         {
-                const auto findIt = method2response.find(methodInfo);
-                return  findIt == method2response.end() ? nullptr : &findIt->second;
+                return method2response.Find(methodInfo);
         }
 
         void SetResponseJsonHandler(const std::string& methodInfo,GenericResponseJsonHandler handler)
@@ -42,8 +42,7 @@ public:
 
         const GenericNotificationJsonHandler* GetNotificationJsonHandler(const char* methodInfo) const
         {
-                const auto findIt = method2notification.find(methodInfo);
-                return  findIt == method2notification.end() ? nullptr : &findIt->second;
+                return method2notification.Find(methodInfo);
         }
 
         void SetNotificationJsonHandler(const std::string& methodInfo, GenericNotificationJsonHandler handler)
@@ -57,5 +56,10 @@ public:
         std::unique_ptr<LspMessage> parseRequstMessage(const std::string&, Reader&);
         bool resovleResponseMessage(Reader&, std::pair<std::string, std::unique_ptr<LspMessage>>& result);
         std::unique_ptr<LspMessage> parseNotificationMessage(const std::string&, Reader&);
+
+        // As above, for a method already looked up in lsp::MethodTable.
+        std::unique_ptr<LspMessage> parseResponseMessage(lsp::MethodId, Reader&);
+        std::unique_ptr<LspMessage> parseRequstMessage(lsp::MethodId, Reader&);
+        std::unique_ptr<LspMessage> parseNotificationMessage(lsp::MethodId, Reader&);
 };
 
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stringViewVersion.h"
+
+namespace lsp
+{
+        // Dense id of a method name; see MethodTable.
+        using MethodId = uint32_t;
+        // Never handed out by the table.
+        constexpr MethodId kInvalidMethodId = 0;
+
+        // Process-wide table of JSON-RPC method names. Every name gets a small
+        // id the first time it is interned, so parsers and handlers can live in
+        // plain arrays indexed by it. Names are looked up through a minimal
+        // perfect hash over everything interned so far: one pass over the name,
+        // one probe and one comparison, without taking a lock. Interning is
+        // meant for start-up; the hash is rebuilt by the first lookup after it.
+        class MethodTable
+        {
+        public:
+                // Never destroyed.
+                static MethodTable& Global();
+
+                MethodTable();
+                ~MethodTable();
+                MethodTable(const MethodTable&) = delete;
+                MethodTable& operator=(const MethodTable&) = delete;
+
+                MethodId Intern(string_view name);
+                // Returns kInvalidMethodId if |name| has never been interned.
+                MethodId Find(string_view name) const;
+                const std::string& Name(MethodId id) const;
+                // Ids run from 1 to size().
+                size_t size() const;
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+
+        // Values of type T indexed by MethodId. operator[] interns the method,
+        // so it can be filled like the std::map it replaces; lookups by id are
+        // an index. Not synchronized: fill it before messages flow.
+        template <typename T>
+        class MethodSlots
+        {
+        public:
+                T& operator[](const std::string& method)
+                {
+                        return operator[](MethodTable::Global().Intern(method));
+                }
+                T& operator[](MethodId id)
+                {
+                        if (id >= slots_.size())
+                                slots_.resize(id + 1);
+                        return slots_[id];
+                }
+
+                // Returns nullptr if nothing is set for |id|.
+                const T* Find(MethodId id) const
+                {
+                        return id < slots_.size() && slots_[id] ? &slots_[id] : nullptr;
+                }
+                const T* Find(string_view method) const
+                {
+                        return Find(MethodTable::Global().Find(method));
+                }
+
+                // Calls |fn| with the method name and value of every set slot.
+                template <typename F>
+                void ForEach(F fn) const
+                {
+                        for (MethodId id = 1; id < slots_.size(); ++id)
+                        {
+                                if (slots_[id])
+                                        fn(MethodTable::Global().Name(id), slots_[id]);
+                        }
+                }
+
+        private:
+                std::vector<T> slots_;
+        };
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lsp
+{
+        // Named counters and gauges that components publish for monitoring.
+        // Counters are plain atomics; look one up once and keep the reference.
+        // Gauges are read through a callback only when a snapshot is taken.
+        class Metrics
+        {
+        public:
+                class Counter
+                {
+                public:
+                        void Add(int64_t delta = 1) { value_.fetch_add(delta, std::memory_order_relaxed); }
+                        void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+                        int64_t Get() const { return value_.load(std::memory_order_relaxed); }
+
+                private:
+                        std::atomic<int64_t> value_{ 0 };
+                };
+
+                using GaugeId = uint64_t;
+
+                static Metrics& Global();
+
+                Metrics();
+                ~Metrics();
+                Metrics(const Metrics&) = delete;
+                Metrics& operator=(const Metrics&) = delete;
+
+                // Returns the counter called |name|, creating it at zero. The
+                // reference stays valid for the lifetime of the registry.
+                Counter& GetCounter(const std::string& name);
+
+                // |read| must stay callable until the gauge is removed, and must not
+                // call back into the registry.
+                GaugeId AddGauge(const std::string& name, std::function<int64_t()> read);
+                void RemoveGauge(GaugeId id);
+
+                // Current value of every counter and gauge, sorted by name.
+                std::vector<std::pair<std::string, int64_t>> Snapshot() const;
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
@@ -5,6 +5,7 @@
 #include "LibLsp/JsonRpc/RequestInMessage.h"
 #include "LibLsp/JsonRpc/NotificationInMessage.h"
 #include "traits.h"
+#include <chrono>
 #include <future>
 #include <string>
 #include "threaded_queue.h"
@@ -14,6 +15,7 @@
 #include "Endpoint.h"
 #include "future.h"
 #include "MessageProducer.h"
+#include "IntakeQueue.h"
 
 
 class MessageJsonHandler;
@@ -134,8 +136,7 @@ public:
         template <typename F, typename RequestType = ParamType<F, 0>, typename ResponseType = typename RequestType::Response>
         IsRequestHandler< F, lsp::ResponseOrError<ResponseType> >  registerHandler(F&& handler)
         {
-                processRequestJsonHandler(handler);
-                local_endpoint->registerRequestHandler(RequestType::kMethodInfo, [=](std::unique_ptr<LspMessage> msg) {
+                registerRequest(RequestType::kMethodInfo, &RequestType::ReflectReader, [=](std::unique_ptr<LspMessage> msg) {
                         auto  req = reinterpret_cast<const RequestType*>(msg.get());
                         lsp::ResponseOrError<ResponseType> res(handler(*req));
                         if (res.is_error) {
@@ -152,8 +153,7 @@ public:
         }
         template <typename F, typename RequestType = ParamType<F, 0>, typename ResponseType = typename RequestType::Response>
         IsRequestHandlerWithMonitor< F, lsp::ResponseOrError<ResponseType> >  registerHandler(F&& handler)  {
-                processRequestJsonHandler(handler);
-                local_endpoint->registerRequestHandler(RequestType::kMethodInfo, [=](std::unique_ptr<LspMessage> msg) {
+                registerRequest(RequestType::kMethodInfo, &RequestType::ReflectReader, [=](std::unique_ptr<LspMessage> msg) {
                         auto  req = static_cast<const RequestType*>(msg.get());
                         lsp::ResponseOrError<ResponseType> res(handler(*req , getCancelMonitor(req->id)));
                         if (res.is_error) {
@@ -173,7 +173,6 @@ public:
         template <typename T, typename F, typename ResponseType = ParamType<F, 0> >
         void send(T& request, F&& handler, RequestErrorCallback onError)
         {
-                processRequestJsonHandler(handler);
                 auto cb = [=](std::unique_ptr<LspMessage> msg) {
                         if (!msg)
                                 return true;
@@ -189,24 +188,13 @@ public:
 
                         return  true;
                 };
-                internalSendRequest(request, cb);
+                internalSendRequest(request, cb, &parseResponse<T>);
         }
 
 
         template <typename F, typename NotifyType = ParamType<F, 0> >
         IsNotify<NotifyType>  registerHandler(F&& handler) {
-                {
-                        std::lock_guard<std::mutex> lock(m_sendMutex);
-                        if (!jsonHandler->GetNotificationJsonHandler(NotifyType::kMethodInfo))
-                        {
-                                jsonHandler->SetNotificationJsonHandler(NotifyType::kMethodInfo,
-                                        [](Reader& visitor)
-                                        {
-                                                return NotifyType::ReflectReader(visitor);
-                                        });
-                        }
-                }
-                local_endpoint->registerNotifyHandler(NotifyType::kMethodInfo, [=](std::unique_ptr<LspMessage> msg) {
+                registerNotification(NotifyType::kMethodInfo, &NotifyType::ReflectReader, [=](std::unique_ptr<LspMessage> msg) {
                         handler(*static_cast<NotifyType*>(msg.get()));
                         return  true;
                         });
@@ -215,7 +203,6 @@ public:
         template <typename T, typename = IsRequest<T>>
         lsp::future< lsp::ResponseOrError<typename T::Response> > send(T& request) {
 
-                processResponseJsonHandler(request);
                 using Response = typename T::Response;
                 auto promise = std::make_shared< lsp::promise<lsp::ResponseOrError<Response>>>();
                 auto cb = [=](std::unique_ptr<LspMessage> msg) {
@@ -238,7 +225,7 @@ public:
                         }
                         return  true;
                 };
-                internalSendRequest(request, cb);
+                internalSendRequest(request, cb, &parseResponse<T>);
                 return promise->get_future();
         }
 
@@ -295,12 +282,49 @@ public:
         void startProcessingMessages(std::shared_ptr<lsp::istream> r,
                 std::shared_ptr<lsp::ostream> w);
 
+        // Incoming messages are parsed in place by default: strings are
+        // decoded inside the buffer they were read into, and only copied once,
+        // into the message objects. Turn it off to log malformed messages
+        // exactly as they arrived.
+        void setParseInsitu(bool insitu);
+
+        // Outgoing messages are serialized by the thread sending them and
+        // written by a thread of the endpoint's own. Senders block while more
+        // than |bytes| wait to be written, until the client reads again.
+        void setSendQueueLimit(size_t bytes);
+
+        // Bounds the messages read but not yet picked up by a worker, and
+        // picks what the reader does with one that does not fit.
+        void setIntakeLimits(const lsp::IntakeQueue::Limits& limits,
+                lsp::IntakeOverflow overflow = lsp::IntakeOverflow::Block);
+
+        // Low priority requests and notifications are the first to be shed
+        // under load. textDocument/codeLens, documentLink, foldingRange and
+        // documentColor are low priority by default. Refused once frozen.
+        bool setLowPriority(const std::string& method, bool low_priority = true);
+
+        // Turns low priority requests away with ServerCancelled as they arrive
+        // while the estimated wait for a worker, from recent handler times, is
+        // over |budget|. 0, the default, turns none away.
+        void setLatencyBudget(std::chrono::milliseconds budget);
+
+        // Ends the registration phase. Afterwards the parser and handler
+        // tables are never written again, so messages are dispatched without
+        // taking any lock, and registerHandler() is refused. Called by
+        // startProcessingMessages(), so every handler has to be registered
+        // before messages flow.
+        void freeze();
+        bool isFrozen() const;
+
         bool isWorking() const;
         void stop();
 
         std::unique_ptr<LspMessage> internalWaitResponse(RequestInMessage&, unsigned time_out = 0);
 
-        bool internalSendRequest(RequestInMessage &info, GenericResponseHandler handler);
+        // |parser| reads the response; without one the parser registered in
+        // the MessageJsonHandler for the request's method is used.
+        bool internalSendRequest(RequestInMessage &info, GenericResponseHandler handler,
+                GenericResponseJsonHandler parser = nullptr);
 
         void handle(std::vector<MessageIssue>&&) override;
         void handle(MessageIssue&&) override;
@@ -308,33 +332,25 @@ private:
         CancelMonitor getCancelMonitor(const lsRequestId&);
         void sendMsg(LspMessage& msg);
         void mainLoop(std::unique_ptr<LspMessage>);
-        bool dispatch(const std::string&);
-        template <typename F, typename RequestType = ParamType<F, 0>>
-        IsRequest<RequestType>  processRequestJsonHandler(const F& handler) {
-                std::lock_guard<std::mutex> lock(m_sendMutex);
-                if (!jsonHandler->GetRequestJsonHandler(RequestType::kMethodInfo))
-                {
-                        jsonHandler->SetRequestJsonHandler(RequestType::kMethodInfo,
-                                [](Reader& visitor)
-                                {
-                                        return RequestType::ReflectReader(visitor);
-                                });
-                }
-        }
-        template <typename T, typename = IsRequest<T>>
-        void processResponseJsonHandler(T& request)
+        bool dispatch(std::string&);
+        // Runs on the reader thread: queues |content| for the workers.
+        void enqueue(std::string&& content);
+        // Answers or drops |content| if it is a low priority message. Returns
+        // false if it has to be handled.
+        bool shed(const std::string& content);
+        // Install the parser, unless one is registered already, and the
+        // handler. Return false, and log, once the registry is frozen.
+        bool registerRequest(const char* method, GenericRequestJsonHandler parser,
+                GenericRequestHandler handler);
+        bool registerNotification(const char* method, GenericNotificationJsonHandler parser,
+                GenericNotificationHandler handler);
+
+        template <typename T>
+        static std::unique_ptr<LspMessage> parseResponse(Reader& visitor)
         {
-                using Response = typename T::Response;
-                std::lock_guard<std::mutex> lock(m_sendMutex);
-                if (!jsonHandler->GetResponseJsonHandler(T::kMethodInfo))
-                {
-                        jsonHandler->SetResponseJsonHandler(T::kMethodInfo, [](Reader& visitor)
-                                {
-                                        if (visitor.HasMember("error"))
-                                                return  Rsp_Error::ReflectReader(visitor);
-                                        return Response::ReflectReader(visitor);
-                                });
-                }
+                if (visitor.HasMember("error"))
+                        return Rsp_Error::ReflectReader(visitor);
+                return T::Response::ReflectReader(visitor);
         }
 
         struct Data;
@@ -342,7 +358,6 @@ private:
         Data* d_ptr;
 
         std::shared_ptr < MessageJsonHandler> jsonHandler;
-        std::mutex m_sendMutex;
 
         std::shared_ptr < Endpoint > local_endpoint;
 public:
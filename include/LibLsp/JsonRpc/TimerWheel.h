@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace lsp
+{
+        // Hierarchical timing wheel: four levels of 64 slots on top of a 1ms tick.
+        // Scheduling and cancelling are O(1). One reactor thread sleeps until the
+        // next occupied slot and hands expired callbacks to the executor.
+        class TimerWheel
+        {
+        public:
+                using TimerId = uint64_t;
+                using Callback = std::function<void()>;
+                // Runs an expired callback. Without one, callbacks run on the reactor
+                // thread and must be short.
+                using Executor = std::function<void(Callback&&)>;
+
+                // Process-wide wheel whose callbacks run on a small thread pool, so
+                // they may run concurrently and out of order. Never destroyed.
+                static TimerWheel& Default();
+
+                explicit TimerWheel(Executor executor = nullptr);
+                // Pending timers are dropped without running.
+                ~TimerWheel();
+
+                TimerWheel(const TimerWheel&) = delete;
+                TimerWheel& operator=(const TimerWheel&) = delete;
+
+                // Runs |callback| once after |delay|. Never returns 0.
+                TimerId Schedule(std::chrono::milliseconds delay, Callback callback);
+                // Runs |callback| every |period| until cancelled.
+                TimerId ScheduleRepeating(std::chrono::milliseconds period, Callback callback);
+
+                // Returns false if the timer already fired (one-shot) or was
+                // cancelled. A callback that is already running is not interrupted.
+                bool Cancel(TimerId id);
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
@@ -47,8 +47,15 @@ namespace lsp
 
             websocket_stream_wrapper& write(std::streamsize _s) override;
 
+            websocket_stream_wrapper& write(const const_buffer* buffers, size_t count) override;
+
             websocket_stream_wrapper& flush() override;
 
+            bool is_message_oriented() override
+            {
+                    return true;
+            }
+
             void clear() override;
 
             std::string what() override;
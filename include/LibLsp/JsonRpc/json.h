@@ -23,6 +23,7 @@ class JsonReader : public Reader {
   bool IsDouble() override { return m_->IsDouble(); }
   bool IsNumber() override { return m_->IsNumber(); }
   bool IsString() override { return m_->IsString(); }
+  bool IsObject() override { return m_->IsObject(); }
 
   void GetNull() override {}
   bool GetBool() override { return m_->GetBool(); }
@@ -31,7 +32,8 @@ class JsonReader : public Reader {
   int64_t GetInt64() override { return m_->GetInt64(); }
   uint64_t GetUint64() override { return m_->GetUint64(); }
   double GetDouble() override { return m_->GetDouble(); }
-  std::string GetString() override { return m_->GetString(); }
+  std::string GetString() override { return std::string(m_->GetString(), m_->GetStringLength()); }
+  string_view GetStringView() override { return string_view(m_->GetString(), m_->GetStringLength()); }
 
   bool HasMember(const char* x) override
   {
@@ -42,7 +44,9 @@ class JsonReader : public Reader {
   }
   std::unique_ptr<Reader> operator[](const char* x) override {
     auto& sub = (*m_)[x];
-    return std::unique_ptr<JsonReader>(new JsonReader(&sub));
+    std::unique_ptr<JsonReader> reader(new JsonReader(&sub));
+    reader->ShareErrorsWith(*this);
+    return std::unique_ptr<Reader>(reader.release());
   }
 
   std::string ToString() const override;
@@ -78,4 +82,6 @@ class JsonWriter : public Writer {
   void StartObject() override { m_->StartObject(); }
   void EndObject() override { m_->EndObject(); }
   void Key(const char* name) override { m_->Key(name); }
+  void Key(const lsp::JsonKey& key) override;
+  void IntArray(const int32_t* values, size_t count) override;
 };
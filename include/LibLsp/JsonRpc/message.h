@@ -4,6 +4,7 @@
 #include <string>
 #include <iostream>
 #include <LibLsp/JsonRpc/serializer.h>
+#include "LibLsp/JsonRpc/MethodTable.h"
 #include "LibLsp/lsp/method_type.h"
 
 struct LspMessage
@@ -18,6 +19,9 @@ public:
 
         virtual MethodType GetMethodType() const = 0;
         virtual void SetMethodType(MethodType) = 0;
+        // Set by RemoteEndPoint to the id it parsed the message under, so
+        // endpoints reach the handler without hashing the name again.
+        lsp::MethodId method_id = lsp::kInvalidMethodId;
 
         virtual ~LspMessage()=default;
         enum Kind
@@ -12,11 +12,42 @@
 #include <algorithm>
 
 #include "optionalVersion.h"
+#include "stringViewVersion.h"
 
 struct AbsolutePath;
 
 enum class SerializeFormat { Json, MessagePack };
 
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define LSPCPP_EXCEPTIONS 1
+#else
+#define LSPCPP_EXCEPTIONS 0
+#endif
+
+namespace lsp
+{
+        // Name of a struct member as passed by REFLECT_MEMBER. Member names are
+        // identifiers, so the macro can also hand over the name already quoted
+        // for JSON, with its length; writers copy that out instead of measuring
+        // and escaping the name on every write. Names known only at run time
+        // convert implicitly and take the ordinary path.
+        struct JsonKey
+        {
+                JsonKey(const char* name) : name(name) {}
+                constexpr JsonKey(const char* name, const char* quoted, size_t quoted_length)
+                        : name(name), quoted(quoted), quoted_length(quoted_length) {}
+
+                operator const char*() const { return name; }
+
+                const char* name;
+                // Null unless built by LSP_JSON_KEY.
+                const char* quoted = nullptr;
+                size_t quoted_length = 0;
+        };
+}
+
+#define LSP_JSON_KEY(name) ::lsp::JsonKey(#name, "\"" #name "\"", sizeof(#name) + 1)
+
 // A tag type that can be used to write `null` to json.
 struct JsonNull
 {
@@ -39,6 +70,10 @@ public:
         virtual bool IsDouble() = 0;
     virtual bool IsNumber() = 0;
     virtual bool IsString() = 0;
+        virtual bool IsObject()
+        {
+                return !IsNull() && !IsBool() && !IsNumber() && !IsString() && !IsArray();
+        }
 
         virtual void GetNull() = 0;
         virtual bool GetBool() = 0;
@@ -48,6 +83,14 @@ public:
         virtual uint64_t GetUint64() = 0;
         virtual double GetDouble() = 0;
         virtual std::string GetString() = 0;
+        // The current string. Readers that can, like JsonReader, return a view
+        // into the document, valid while it is alive. This default copies
+        // the string into the reader, valid until the next call.
+        virtual string_view GetStringView()
+        {
+                string_scratch_ = GetString();
+                return string_scratch_;
+        }
 
         virtual bool HasMember(const char* x) = 0;
         virtual std::unique_ptr<Reader> operator[](const char* x) = 0;
@@ -55,6 +98,38 @@ public:
         virtual void IterArray(std::function<void(Reader&)> fn) = 0;
         virtual void DoMember(const char* name, std::function<void(Reader&)> fn) = 0;
         virtual std::string ToString() const = 0;
+
+        // Called by Reflect() when the value is not of the expected kind. It
+        // throws std::invalid_argument, unless exceptions are disabled or
+        // SetThrowOnError(false) was called; then the first error is kept,
+        // the value is left as it was and reading goes on.
+        void Fail(const char* expected);
+        void SetThrowOnError(bool throw_on_error) { throw_on_error_ = throw_on_error; }
+        bool ThrowsOnError() const { return throw_on_error_; }
+        bool HasError() const { return !error_->empty(); }
+        const std::string& GetError() const { return *error_; }
+        void ClearError() { error_->clear(); }
+
+protected:
+        Reader() = default;
+        Reader(const Reader& other) : throw_on_error_(other.throw_on_error_) {}
+        Reader& operator=(const Reader&) = delete;
+
+        // Makes this reader, built for a member of |parent|, throw like it
+        // and record its errors where |parent| does, so that they show on
+        // the reader the caller holds. It must not outlive |parent|.
+        void ShareErrorsWith(Reader& parent)
+        {
+                error_ = parent.error_;
+                throw_on_error_ = parent.throw_on_error_;
+        }
+
+private:
+        std::string string_scratch_;
+        std::string own_error_;
+        // |own_error_|, or that of the reader this one was built from.
+        std::string* error_ = &own_error_;
+        bool throw_on_error_ = LSPCPP_EXCEPTIONS;
 };
 
 
@@ -78,6 +153,18 @@ public:
         virtual void StartObject() = 0;
         virtual void EndObject() = 0;
         virtual void Key(const char* name) = 0;
+        // Formats that can use the pre-quoted name override this.
+        virtual void Key(const lsp::JsonKey& key) { Key(key.name); }
+
+        // Writes |values| as an array of numbers. Formats that can emit the
+        // whole array at once override this.
+        virtual void IntArray(const int32_t* values, size_t count)
+        {
+                StartArray(count);
+                for (size_t i = 0; i < count; ++i)
+                        Int(values[i]);
+                EndArray();
+        }
 };
 
 
@@ -87,9 +174,9 @@ struct optionals_mandatory_tag {};
 #define REFLECT_MEMBER_START() ReflectMemberStart(visitor, value)
 #define REFLECT_MEMBER_END() ReflectMemberEnd(visitor, value);
 #define REFLECT_MEMBER_END1(value) ReflectMemberEnd(visitor, value);
-#define REFLECT_MEMBER(name) ReflectMember(visitor, #name, value.name)
+#define REFLECT_MEMBER(name) ReflectMember(visitor, LSP_JSON_KEY(name), value.name)
 #define REFLECT_MEMBER_OPTIONALS(name) \
-  ReflectMember(visitor, #name, value.name, optionals_mandatory_tag{})
+  ReflectMember(visitor, LSP_JSON_KEY(name), value.name, optionals_mandatory_tag{})
 #define REFLECT_MEMBER2(name, value) ReflectMember(visitor, name, value)
 
 #define MAKE_REFLECT_TYPE_PROXY(type_name) \
@@ -221,7 +308,7 @@ void Reflect(Writer& visitor, optional<T>& value) {
 
 
 template <typename T>
-void ReflectMember(Writer& visitor, const char* name, optional<T>& value) {
+void ReflectMember(Writer& visitor, const lsp::JsonKey& name, optional<T>& value) {
         // For TypeScript optional property key?: value in the spec,
         // We omit both key and value if value is std::nullopt (null) for JsonWriter
         // to reduce output. But keep it for other serialization formats.
@@ -234,7 +321,7 @@ void ReflectMember(Writer& visitor, const char* name, optional<T>& value) {
 
 template <typename T>
 void ReflectMember(Writer& visitor,
-        const char* name,
+        const lsp::JsonKey& name,
         T& value,
         optionals_mandatory_tag) {
         visitor.Key(name);
@@ -280,6 +367,8 @@ void Reflect(Reader& visitor, std::vector<T>& values) {
 }
 
 
+void Reflect(Writer& visitor, std::vector<int32_t>& values);
+
 template <typename T>
 void Reflect(Writer& visitor, std::vector<T>& values) {
         visitor.StartArray(values.size());
@@ -317,7 +406,7 @@ void ReflectMember(Reader& visitor, const char* name, T& value) {
         visitor.DoMember(name, [&](Reader& child) { Reflect(child, value); });
 }
 template <typename T>
-void ReflectMember(Writer& visitor, const char* name, T& value) {
+void ReflectMember(Writer& visitor, const lsp::JsonKey& name, T& value) {
         visitor.Key(name);
         Reflect(visitor, value);
 }
@@ -358,15 +447,201 @@ void Reflect(Reader& visitor, std::pair<  optional<std::string>, optional<_Ty2>
 }
 
 
+namespace lsp
+{
+namespace json_shape
+{
+        // Tells the alternatives of an Either apart by looking at the JSON
+        // without deserializing it: a value "matches" T when Reflect(Reader&,
+        // T&) would accept its kind, and a matching object is "complete" when
+        // every non-optional member of T is present. Structs are inspected
+        // through their MAKE_REFLECT_STRUCT Reflect with MemberVisitor; types
+        // with a hand-written Reader overload are assumed to match anything.
+        struct Shape
+        {
+                bool matches;
+                bool complete;
+        };
+
+        template <typename T>
+        struct Tag {};
+
+        struct MemberVisitor
+        {
+                Reader& reader;
+                Shape shape;
+        };
+
+        template <typename T>
+        struct IsOptional : std::false_type {};
+        template <typename T>
+        struct IsOptional<optional<T>> : std::true_type {};
+
+        template <typename T, typename = void>
+        struct HasStructReflect : std::false_type {};
+        template <typename T>
+        struct HasStructReflect<T, decltype(Reflect(std::declval<MemberVisitor&>(), std::declval<T&>()), void())>
+                : std::true_type {};
+
+        // Kinds mirror the checks of the elementary Reflect overloads.
+        inline bool Matches(Reader& visitor, Tag<uint8_t>) { return visitor.IsInt(); }
+        inline bool Matches(Reader& visitor, Tag<short>) { return visitor.IsInt(); }
+        inline bool Matches(Reader& visitor, Tag<unsigned short>) { return visitor.IsInt(); }
+        inline bool Matches(Reader& visitor, Tag<int>) { return visitor.IsInt(); }
+        inline bool Matches(Reader& visitor, Tag<unsigned>) { return visitor.IsUint64(); }
+        inline bool Matches(Reader& visitor, Tag<long>) { return visitor.IsInt64(); }
+        inline bool Matches(Reader& visitor, Tag<unsigned long>) { return visitor.IsUint64(); }
+        inline bool Matches(Reader& visitor, Tag<long long>) { return visitor.IsInt64(); }
+        inline bool Matches(Reader& visitor, Tag<unsigned long long>) { return visitor.IsUint64(); }
+        inline bool Matches(Reader& visitor, Tag<double>) { return visitor.IsNumber(); }
+        inline bool Matches(Reader& visitor, Tag<bool>) { return visitor.IsBool(); }
+        inline bool Matches(Reader& visitor, Tag<std::string>) { return visitor.IsString(); }
+
+        template <typename T>
+        bool Matches(Reader& visitor, Tag<optional<T>>)
+        {
+                return visitor.IsNull() || Matches(visitor, Tag<T>());
+        }
+        template <typename T>
+        Shape Inspect(Reader& visitor);
+
+        // An array is judged by its first element; an empty one fits any
+        // element type.
+        template <typename T>
+        Shape InspectArray(Reader& visitor)
+        {
+                if (!visitor.IsArray())
+                        return { false, false };
+                Shape shape{ true, true };
+                bool first = true;
+                visitor.IterArray([&](Reader& element)
+                {
+                        if (!first)
+                                return;
+                        first = false;
+                        shape = Inspect<T>(element);
+                });
+                return shape;
+        }
+        template <typename T>
+        bool Matches(Reader& visitor, Tag<std::vector<T>>)
+        {
+                return InspectArray<T>(visitor).matches;
+        }
+        template <typename T>
+        bool Matches(Reader& visitor, Tag<std::map<std::string, T>>)
+        {
+                return visitor.IsObject();
+        }
+        template <typename T1, typename T2>
+        bool Matches(Reader& visitor, Tag<std::pair<optional<T1>, optional<T2>>>)
+        {
+                return Matches(visitor, Tag<T1>()) || Matches(visitor, Tag<T2>());
+        }
+        template <typename T>
+        Shape InspectStruct(Reader& visitor)
+        {
+                if (!visitor.IsObject())
+                        return { false, false };
+                MemberVisitor members{ visitor, { true, true } };
+                T prototype;
+                Reflect(members, prototype);
+                return members.shape;
+        }
+
+        template <typename T>
+        bool MatchesOther(Reader& visitor, std::true_type)
+        {
+                return InspectStruct<T>(visitor).matches;
+        }
+        template <typename T>
+        bool MatchesOther(Reader&, std::false_type)
+        {
+                return true;
+        }
+        template <typename T>
+        bool Matches(Reader& visitor, Tag<T>)
+        {
+                return MatchesOther<T>(visitor, HasStructReflect<T>());
+        }
+
+        template <typename T>
+        Shape InspectOther(Reader& visitor, std::true_type)
+        {
+                return InspectStruct<T>(visitor);
+        }
+        template <typename T>
+        Shape InspectOther(Reader& visitor, std::false_type)
+        {
+                const bool matches = Matches(visitor, Tag<T>());
+                return { matches, matches };
+        }
+        template <typename T>
+        Shape InspectTagged(Reader& visitor, Tag<T>)
+        {
+                return InspectOther<T>(visitor, HasStructReflect<T>());
+        }
+        template <typename T>
+        Shape InspectTagged(Reader& visitor, Tag<std::vector<T>>)
+        {
+                return InspectArray<T>(visitor);
+        }
+        template <typename T>
+        Shape Inspect(Reader& visitor)
+        {
+                return InspectTagged(visitor, Tag<T>());
+        }
+
+        template <typename T>
+        bool ReflectMemberStart(MemberVisitor&, T&)
+        {
+                return false;
+        }
+        template <typename T>
+        void ReflectMemberEnd(MemberVisitor&, T&) {}
+
+        template <typename T>
+        void ReflectMember(MemberVisitor& visitor, const char* name, T&)
+        {
+                if (!visitor.shape.matches)
+                        return;
+                bool present = false;
+                visitor.reader.DoMember(name, [&](Reader& member)
+                {
+                        present = true;
+                        if (!Matches(member, Tag<T>()))
+                                visitor.shape.matches = false;
+                });
+                if (!present && !IsOptional<T>::value)
+                        visitor.shape.complete = false;
+        }
+        template <typename T>
+        void ReflectMember(MemberVisitor& visitor, const char* name, T& value, optionals_mandatory_tag)
+        {
+                ReflectMember(visitor, name, value);
+        }
+}
+}
+
+// Reads the second alternative unless the JSON fits only the first, or fits
+// the first completely and the second only partly.
 template<class _Ty1, class _Ty2>
 void Reflect(Reader& visitor, std::pair<  optional<_Ty1>, optional<_Ty2> >& value)
 {
-        try
+        using namespace lsp::json_shape;
+        const Shape second = Inspect<_Ty2>(visitor);
+        if (second.matches && second.complete)
         {
                 Reflect(visitor, value.second);
+                return;
         }
-        catch (...)
+        const Shape first = Inspect<_Ty1>(visitor);
+        if (first.matches ? (!second.matches || first.complete) : !second.matches)
         {
                 Reflect(visitor, value.first);
         }
+        else
+        {
+                Reflect(visitor, value.second);
+        }
 }
@@ -1,8 +1,17 @@
 #pragma once
+#include <cstddef>
 #include <mutex>
 #include <string>
 namespace lsp
 {
+        // One piece of a gather write. The memory belongs to the caller and is
+        // only valid during the write call.
+        struct const_buffer
+        {
+                const char* data;
+                size_t size;
+        };
+
         class stream
         {
         public:
@@ -80,6 +89,23 @@ namespace lsp
                 virtual  ostream& write(std::streamsize) = 0;
                 virtual  ostream& flush() = 0;
 
+                // Writes |count| buffers back to back. Streams that can send
+                // them without joining them first should override this.
+                virtual  ostream& write(const const_buffer* buffers, size_t count)
+                {
+                        for (size_t i = 0; i < count; ++i)
+                                write(std::string(buffers[i].data, buffers[i].size));
+                        return *this;
+                }
+
+                // True if each write() is delivered as one message rather than
+                // appended to a byte stream, so separate frames must not be
+                // joined into one write.
+                virtual  bool is_message_oriented()
+                {
+                        return false;
+                }
+
         };
         template <class T >
         class base_ostream : public ostream
@@ -120,6 +146,13 @@ namespace lsp
                         return *this;
                 }
 
+                ostream& write(const const_buffer* buffers, size_t count) override
+                {
+                        for (size_t i = 0; i < count; ++i)
+                                _impl.write(buffers[i].data, buffers[i].size);
+                        return *this;
+                }
+
                 ostream& flush() override
                 {
                         _impl.flush();
@@ -180,6 +213,13 @@ namespace lsp
                         return *this;
                 }
 
+                ostream& write(const const_buffer* buffers, size_t count) override
+                {
+                        for (size_t i = 0; i < count; ++i)
+                                _impl.write(buffers[i].data, buffers[i].size);
+                        return *this;
+                }
+
                 ostream& flush() override
                 {
                         _impl.flush();
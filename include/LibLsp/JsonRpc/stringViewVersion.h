@@ -0,0 +1,12 @@
+#pragma once
+#if __cplusplus < 201703L
+
+#include <boost/utility/string_view.hpp>
+using boost::string_view;
+
+#else
+
+#include <string_view>
+using std::string_view;
+
+#endif
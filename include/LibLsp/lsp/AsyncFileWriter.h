@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include "LibLsp/JsonRpc/future.h"
+
+namespace lsp
+{
+        // How hard AsyncFileWriter tries to make a completed write durable.
+        enum class FsyncPolicy
+        {
+                // Rely on the OS to flush the page cache eventually.
+                None,
+                // fsync the temp file before it is renamed over the target.
+                File,
+                // Like File, and also fsync the containing directory so the rename
+                // itself survives a crash.
+                FileAndDirectory
+        };
+
+        // Writes |content| to a temp file next to |filename| and renames it into
+        // place, so readers only ever observe the old or the new content. If
+        // |filename| is a symbolic link, the file it points to is replaced and
+        // the link kept. The new file gets the mode and, as far as permitted,
+        // the owner of the one it replaces.
+        bool WriteToFileAtomic(const std::string& filename, const std::string& content,
+                FsyncPolicy policy = FsyncPolicy::File);
+
+        // Background I/O queue for document persistence. Writes are performed on a
+        // single worker thread; a write that is still queued when a newer one for
+        // the same file arrives is dropped and its future completes with the result
+        // of the newer write.
+        class AsyncFileWriter
+        {
+        public:
+                explicit AsyncFileWriter(FsyncPolicy policy = FsyncPolicy::File);
+                // Completes all queued writes before returning.
+                ~AsyncFileWriter();
+
+                AsyncFileWriter(const AsyncFileWriter&) = delete;
+                AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+                lsp::future<bool> Write(const std::string& filename, std::string&& content);
+
+                // Blocks until every write queued before this call has finished.
+                void Flush();
+
+                void SetFsyncPolicy(FsyncPolicy policy);
+                FsyncPolicy GetFsyncPolicy() const;
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "LibLsp/JsonRpc/MessageIssue.h"
+#include "LibLsp/lsp/workspace/did_change_watched_files.h"
+
+namespace lsp
+{
+        struct FileWatcherOptions
+        {
+                // Events for a path are held back until it has been quiet for this
+                // long, then merged into a single change.
+                std::chrono::milliseconds debounce{ 100 };
+                // Directories and files that are never watched or reported, with the
+                // same matching rules as ScanOptions::exclude_globs.
+                std::vector<std::string> exclude_globs;
+                // If not empty, only changes to absolute paths matching one of these
+                // GlobSet patterns are reported, e.g. the globPatterns of the
+                // client's file system watcher registrations.
+                std::vector<std::string> include_globs;
+        };
+
+        // Watches workspace folders for changes made outside of the client and
+        // reports them as didChangeWatchedFiles batches. Backed by inotify on
+        // Linux; on other platforms AddRoot always fails and nothing is reported.
+        class FileWatcher
+        {
+        public:
+                // |callback| runs on the watcher thread, once per batch of debounced
+                // changes.
+                using Callback = std::function<void(lsDidChangeWatchedFilesParams&)>;
+
+                FileWatcher(lsp::Log& log, Callback callback, const FileWatcherOptions& options = {});
+                ~FileWatcher();
+
+                FileWatcher(const FileWatcher&) = delete;
+                FileWatcher& operator=(const FileWatcher&) = delete;
+
+                // Watches |root| and every directory below it, including directories
+                // created later. Returns false if |root| cannot be watched, or if
+                // the watcher could not set up inotify.
+                bool AddRoot(const std::string& root);
+                void RemoveRoot(const std::string& root);
+
+                // Whether this process can create inotify instances; checked once.
+                static bool IsSupported();
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "LibLsp/JsonRpc/stringViewVersion.h"
+
+namespace lsp
+{
+        // A set of glob patterns compiled into one automaton, so a path is tested
+        // against all of them in a single pass over its characters.
+        //
+        // Supports the LSP glob syntax:
+        //   *        any run of characters except '/'
+        //   ?        one character except '/'
+        //   **       any run of characters including '/'; '**/' also matches
+        //            no directory at all
+        //   {a,b}    any of the comma separated alternatives, may be nested
+        //   [a-z]    one character of the class, [!a-z] negates it
+        // Patterns must match the whole path.
+        class GlobSet
+        {
+        public:
+                GlobSet();
+                explicit GlobSet(const std::vector<std::string>& patterns);
+                ~GlobSet();
+
+                GlobSet(GlobSet&& other) noexcept;
+                GlobSet& operator=(GlobSet&& other) noexcept;
+                GlobSet(const GlobSet&) = delete;
+                GlobSet& operator=(const GlobSet&) = delete;
+
+                // Returns the index Matches() reports |pattern| under. Build() must
+                // be called before matching again.
+                size_t Add(const std::string& pattern);
+                void Build();
+
+                bool empty() const;
+                size_t size() const;
+
+                bool IsMatch(const string_view& path) const;
+                // Indices of every pattern that matches |path|, in increasing order.
+                std::vector<size_t> Matches(const string_view& path) const;
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "LibLsp/lsp/lsDocumentUri.h"
+#include "LibLsp/lsp/textDocument/SemanticTokens.h"
+
+namespace lsp
+{
+        // Remembers the semantic tokens last sent for each document, so that
+        // textDocument/semanticTokens/full/delta can be answered with edits
+        // instead of the whole array. Only the latest result of a document is
+        // kept: a request naming any other resultId gets the full tokens. Least
+        // recently used documents are dropped past |max_documents|, and when the
+        // MemoryBudget asks for memory back. Thread-safe.
+        class SemanticTokensCache
+        {
+        public:
+                explicit SemanticTokensCache(size_t max_documents = 256);
+                ~SemanticTokensCache();
+                SemanticTokensCache(const SemanticTokensCache&) = delete;
+                SemanticTokensCache& operator=(const SemanticTokensCache&) = delete;
+
+                // Result of textDocument/semanticTokens/full. Remembers |tokens|
+                // under a new resultId.
+                SemanticTokens Full(const lsDocumentUri& uri, std::vector<SemanticToken> tokens);
+
+                // Result of textDocument/semanticTokens/full/delta: edits from the
+                // tokens sent as |previous_result_id|, or the full tokens if those
+                // are no longer known.
+                SemanticTokensOrDelta Delta(const lsDocumentUri& uri,
+                        const std::string& previous_result_id, std::vector<SemanticToken> tokens);
+
+                // Forgets the tokens of |uri|, e.g. once the document is closed.
+                void Remove(const lsDocumentUri& uri);
+                void Clear();
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
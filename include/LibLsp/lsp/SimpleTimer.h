@@ -1,29 +1,44 @@
 #pragma once
-#include <thread>
-#include <atomic>
+#include <condition_variable>
 #include <functional>
-#include <boost/asio.hpp>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include "LibLsp/JsonRpc/TimerWheel.h"
 
+// One-shot timer on the shared lsp::TimerWheel; no thread of its own. The
+// callback runs on the wheel's executor. Once Stop() or the destructor
+// returns, the callback is not running and never will; called from the
+// callback itself, they return without waiting.
 template<typename Duration = boost::posix_time::milliseconds>
 class SimpleTimer
 {
 public:
     SimpleTimer(unsigned int duration,const std::function<void()>& _call_back)
-        :is_running_(true), call_back(_call_back), _deadline_timer(_ios, Duration(duration))
+        :state_(std::make_shared<State>())
     {
-        _deadline_timer.async_wait([&](const boost::system::error_code& e)
+        auto state = state_;
+        auto call_back = _call_back;
+        _timer_id = lsp::TimerWheel::Default().Schedule(
+            std::chrono::milliseconds(Duration(duration).total_milliseconds()),
+            [state, call_back]()
         {
-            if (e.value() == boost::asio::error::operation_aborted)
             {
-                return;
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->is_running)
+                    return;
+                state->in_callback = true;
+                state->callback_thread = std::this_thread::get_id();
             }
-            if(is_running_.load(std::memory_order_relaxed))
+            call_back();
             {
-                call_back();
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->in_callback = false;
+                state->is_running = false;
             }
-
+            state->cv.notify_all();
         });
-        _thread = std::thread([this] { _ios.run(); });
     }
     ~SimpleTimer()
     {
@@ -31,19 +46,23 @@ public:
     }
     void Stop()
     {
-        is_running_.store(false, std::memory_order_relaxed);
-        _ios.stop();
-        if (_thread.joinable())
-        {
-            _thread.join();
-        }
+        lsp::TimerWheel::Default().Cancel(_timer_id);
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->is_running = false;
+        if (state_->callback_thread != std::this_thread::get_id())
+            state_->cv.wait(lock, [this] { return !state_->in_callback; });
     }
 private:
-    std::atomic_bool is_running_;
-    std::function<void()> call_back;
-    boost::asio::io_service _ios;
-    boost::asio::deadline_timer _deadline_timer;
-    std::thread _thread;
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool is_running = true;
+        bool in_callback = false;
+        std::thread::id callback_thread;
+    };
+    std::shared_ptr<State> state_;
+    lsp::TimerWheel::TimerId _timer_id;
 
 
 };
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "LibLsp/lsp/AbsolutePath.h"
+#include "LibLsp/lsp/lsDocumentUri.h"
+
+namespace lsp
+{
+        // Process-wide intern table for document URIs and the paths they
+        // resolve to. Every distinct URI gets a small id whose normalized path is
+        // computed once, so hot structures can key and compare on the id instead
+        // of the full strings. Several URIs may spell the same path; they share a
+        // PathId. Entries are never removed, and references returned by the
+        // accessors stay valid for the lifetime of the table.
+        class UriTable
+        {
+        public:
+                using UriId = uint32_t;
+                using PathId = uint32_t;
+                // Never handed out by the table.
+                static constexpr uint32_t kInvalidId = 0;
+
+                // Never destroyed.
+                static UriTable& Global();
+
+                UriTable();
+                ~UriTable();
+                UriTable(const UriTable&) = delete;
+                UriTable& operator=(const UriTable&) = delete;
+
+                // Normalizes |raw_uri| the first time it is seen.
+                UriId Intern(const std::string& raw_uri);
+                UriId Intern(const lsDocumentUri& uri) { return Intern(uri.raw_uri_); }
+                // Returns kInvalidId if |raw_uri| has never been interned.
+                UriId Find(const std::string& raw_uri) const;
+
+                const std::string& Uri(UriId id) const;
+                const AbsolutePath& Path(UriId id) const;
+                PathId PathIdOf(UriId id) const;
+
+                PathId InternPath(const AbsolutePath& path);
+                // Returns kInvalidId if no interned URI or path resolved to |path|.
+                PathId FindPath(const std::string& path) const;
+                const AbsolutePath& GetPath(PathId id) const;
+
+                size_t UriCount() const;
+                size_t PathCount() const;
+
+        private:
+                struct Data;
+                Data* d_ptr;
+        };
+}
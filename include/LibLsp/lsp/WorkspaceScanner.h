@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace lsp
+{
+        struct ScanOptions
+        {
+                // Only report files ending with one of these suffixes, compared
+                // case-insensitively. Empty reports every regular file.
+                std::vector<std::string> suffixes;
+                // Files and directories to skip. A glob containing '/' is matched
+                // against the path relative to the root, otherwise against the entry
+                // name, using the GlobSet syntax. Excluded directories are not
+                // descended into.
+                std::vector<std::string> exclude_globs;
+                // Number of walker threads; 0 picks the hardware concurrency.
+                // Workers with nothing to steal sleep until a directory is queued.
+                unsigned threads = 0;
+        };
+
+        // Receives each matching file as soon as it is found. It is called
+        // concurrently from the walker threads, so it must be thread-safe.
+        using ScanCallback = std::function<void(const std::string& path)>;
+
+        // Walks |root| with several threads that steal directories from each
+        // other. Symbolic links to files are reported, symbolic links to
+        // directories are not followed. Returns once the whole tree was visited.
+        void ScanWorkspace(const std::string& root, const ScanOptions& options, const ScanCallback& callback);
+}
@@ -1,16 +1,35 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cassert>
-#include <limits>
+#include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
-// Cache that evicts old entries which have not been used recently. Implemented
-// using array/linear search so this works well for small array sizes.
-template <typename TKey, typename TValue>
+// Cache that evicts old entries which have not been used recently. Entries are
+// kept in a list ordered by last use and indexed by a hash map, so every
+// operation is O(1).
+//
+// Besides the entry count the cache can be bounded by bytes: give it a
+// |max_bytes| and a function returning the cost of an entry. The entry that is
+// being inserted is never evicted by its own insertion.
+//
+// Not thread-safe; see ConcurrentLruCache.
+template <typename TKey, typename TValue, typename THash = std::hash<TKey>>
 struct LruCache {
-  explicit LruCache(int max_entries);
+  using CostFunction = std::function<size_t(const TKey&, const TValue&)>;
+
+  explicit LruCache(int max_entries, size_t max_bytes = 0,
+                    CostFunction cost = nullptr);
+  // The index points into the entry list, so a copy could not share it.
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+  LruCache(LruCache&&) = default;
+  LruCache& operator=(LruCache&&) = default;
 
   // Fetches an entry for |key|. If it does not exist, |allocator| will be
   // invoked to create one.
@@ -23,49 +42,63 @@ struct LruCache {
   bool TryGet(const TKey& key, TValue* dest);
   // TryGetEntry, except the entry is removed from the cache.
   bool TryTake(const TKey& key, TValue* dest);
-  // Inserts an entry. Evicts the oldest unused entry if there is no space.
+  // Inserts or replaces an entry. Evicts the oldest unused entries if there is
+  // no space.
   void Insert(const TKey& key, const TValue& value);
 
-  // Call |func| on existing entries. If |func| returns false iteration
-  // terminates early.
+  // Call |func| on existing entries, most recently used first. If |func|
+  // returns false iteration terminates early.
   template <typename TFunc>
   void IterateValues(TFunc func);
 
+  // Evicts the least recently used entries until at most |max_bytes| are held.
+  // Returns the number of bytes released.
+  size_t TrimTo(size_t max_bytes);
+
   // Empties the cache
   void Clear(void);
 
+  size_t size() const { return entries_.size(); }
+  size_t bytes() const { return bytes_; }
+
  private:
-  // There is a global score counter, when we access an element we increase
-  // its score to the current global value, so it has the highest overall
-  // score. This means that the oldest/least recently accessed value has the
-  // lowest score.
-  //
-  // There is a bit of special logic to handle score overlow.
   struct Entry {
-    uint32_t score = 0;
     TKey key;
     TValue value;
-    bool operator<(const Entry& other) const { return score < other.score; }
+    size_t cost = 0;
   };
+  using EntryList = std::list<Entry>;
 
-  void IncrementScore();
+  // Moves |it| to the most recently used position.
+  void Touch(typename EntryList::iterator it);
+  void Erase(typename EntryList::iterator it);
+  // Evicts from the back while over budget, sparing the front entry.
+  void EvictOverflow();
 
-  std::vector<Entry> entries_;
-  int max_entries_ = 1;
-  uint32_t next_score_ = 0;
+  EntryList entries_;
+  std::unordered_map<TKey, typename EntryList::iterator, THash> index_;
+  size_t max_entries_ = 1;
+  size_t max_bytes_ = 0;
+  size_t bytes_ = 0;
+  CostFunction cost_;
 };
 
-template <typename TKey, typename TValue>
-LruCache<TKey, TValue>::LruCache(int max_entries) : max_entries_(max_entries) {
+template <typename TKey, typename TValue, typename THash>
+LruCache<TKey, TValue, THash>::LruCache(int max_entries,
+                                        size_t max_bytes,
+                                        CostFunction cost)
+    : max_entries_(max_entries), max_bytes_(max_bytes), cost_(std::move(cost)) {
   assert(max_entries > 0);
 }
 
-template <typename TKey, typename TValue>
+template <typename TKey, typename TValue, typename THash>
 template <typename TAllocator>
-TValue LruCache<TKey, TValue>::Get(const TKey& key, TAllocator allocator) {
-  for (Entry& entry : entries_) {
-    if (entry.key == key)
-      return entry.value;
+TValue LruCache<TKey, TValue, THash>::Get(const TKey& key,
+                                          TAllocator allocator) {
+  auto findIt = index_.find(key);
+  if (findIt != index_.end()) {
+    Touch(findIt->second);
+    return findIt->second->value;
   }
 
   auto result = allocator();
@@ -73,79 +106,260 @@ TValue LruCache<TKey, TValue>::Get(const TKey& key, TAllocator allocator) {
   return result;
 }
 
-template <typename TKey, typename TValue>
-bool LruCache<TKey, TValue>::Has(const TKey& key) {
-  for (Entry& entry : entries_) {
-    if (entry.key == key)
-      return true;
+template <typename TKey, typename TValue, typename THash>
+bool LruCache<TKey, TValue, THash>::Has(const TKey& key) {
+  return index_.find(key) != index_.end();
+}
+
+template <typename TKey, typename TValue, typename THash>
+bool LruCache<TKey, TValue, THash>::TryGet(const TKey& key, TValue* dest) {
+  auto findIt = index_.find(key);
+  if (findIt == index_.end())
+    return false;
+  Touch(findIt->second);
+  if (dest)
+    *dest = findIt->second->value;
+  return true;
+}
+
+template <typename TKey, typename TValue, typename THash>
+bool LruCache<TKey, TValue, THash>::TryTake(const TKey& key, TValue* dest) {
+  auto findIt = index_.find(key);
+  if (findIt == index_.end())
+    return false;
+  if (dest)
+    *dest = std::move(findIt->second->value);
+  Erase(findIt->second);
+  return true;
+}
+
+template <typename TKey, typename TValue, typename THash>
+void LruCache<TKey, TValue, THash>::Insert(const TKey& key,
+                                           const TValue& value) {
+  const size_t cost = cost_ ? cost_(key, value) : 0;
+  auto findIt = index_.find(key);
+  if (findIt != index_.end()) {
+    auto it = findIt->second;
+    bytes_ = bytes_ - it->cost + cost;
+    it->value = value;
+    it->cost = cost;
+    Touch(it);
+  } else {
+    entries_.push_front(Entry{key, value, cost});
+    index_.emplace(key, entries_.begin());
+    bytes_ += cost;
   }
-  return false;
+  EvictOverflow();
 }
 
-template <typename TKey, typename TValue>
-bool LruCache<TKey, TValue>::TryGet(const TKey& key, TValue* dest) {
-  // Assign new score.
+template <typename TKey, typename TValue, typename THash>
+template <typename TFunc>
+void LruCache<TKey, TValue, THash>::IterateValues(TFunc func) {
   for (Entry& entry : entries_) {
-    if (entry.key == key) {
-      entry.score = next_score_;
-      IncrementScore();
-      if (dest)
-        *dest = entry.value;
-      return true;
-    }
+    if (!func(entry.value))
+      break;
+  }
+}
+
+template <typename TKey, typename TValue, typename THash>
+size_t LruCache<TKey, TValue, THash>::TrimTo(size_t max_bytes) {
+  const size_t before = bytes_;
+  while (!entries_.empty() && bytes_ > max_bytes)
+    Erase(std::prev(entries_.end()));
+  return before - bytes_;
+}
+
+template <typename TKey, typename TValue, typename THash>
+void LruCache<TKey, TValue, THash>::Touch(typename EntryList::iterator it) {
+  if (it != entries_.begin())
+    entries_.splice(entries_.begin(), entries_, it);
+}
+
+template <typename TKey, typename TValue, typename THash>
+void LruCache<TKey, TValue, THash>::Erase(typename EntryList::iterator it) {
+  bytes_ -= it->cost;
+  index_.erase(it->key);
+  entries_.erase(it);
+}
+
+template <typename TKey, typename TValue, typename THash>
+void LruCache<TKey, TValue, THash>::EvictOverflow() {
+  while (entries_.size() > 1 &&
+         (entries_.size() > max_entries_ || (max_bytes_ && bytes_ > max_bytes_)))
+    Erase(std::prev(entries_.end()));
+}
+
+template <typename TKey, typename TValue, typename THash>
+void LruCache<TKey, TValue, THash>::Clear(void) {
+  entries_.clear();
+  index_.clear();
+  bytes_ = 0;
+}
+
+// Thread-safe LruCache split into independently locked shards. The entry and
+// byte limits are divided evenly between the shards, so recency is tracked
+// per shard rather than globally.
+template <typename TKey,
+          typename TValue,
+          typename THash = std::hash<TKey>,
+          size_t kShards = 16>
+struct ConcurrentLruCache {
+  using Cache = LruCache<TKey, TValue, THash>;
+
+  explicit ConcurrentLruCache(int max_entries,
+                              size_t max_bytes = 0,
+                              typename Cache::CostFunction cost = nullptr);
+
+  // Like LruCache::Get, but |allocator| runs without holding any lock; two
+  // threads missing on the same key may both allocate, the last one wins.
+  template <typename TAllocator>
+  TValue Get(const TKey& key, TAllocator allocator);
+  bool Has(const TKey& key);
+  bool TryGet(const TKey& key, TValue* dest);
+  bool TryTake(const TKey& key, TValue* dest);
+  void Insert(const TKey& key, const TValue& value);
+
+  // Visits one shard at a time while holding its lock.
+  template <typename TFunc>
+  void IterateValues(TFunc func);
+
+  size_t TrimTo(size_t max_bytes);
+  void Clear(void);
+
+  size_t size();
+  size_t bytes();
+
+ private:
+  struct Shard {
+    Shard(int max_entries,
+          size_t max_bytes,
+          const typename Cache::CostFunction& cost)
+        : cache(max_entries, max_bytes, cost) {}
+    std::mutex mutex;
+    Cache cache;
+  };
+
+  Shard& ShardFor(const TKey& key) {
+    return *shards_[THash()(key) % kShards];
   }
 
-  return false;
+  std::array<std::unique_ptr<Shard>, kShards> shards_;
+};
+
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+ConcurrentLruCache<TKey, TValue, THash, kShards>::ConcurrentLruCache(
+    int max_entries,
+    size_t max_bytes,
+    typename Cache::CostFunction cost) {
+  static_assert(kShards > 0, "need at least one shard");
+  const int shard_entries =
+      std::max<int>(1, (max_entries + kShards - 1) / kShards);
+  const size_t shard_bytes = max_bytes ? std::max<size_t>(1, max_bytes / kShards) : 0;
+  for (auto& shard : shards_)
+    shard.reset(new Shard(shard_entries, shard_bytes, cost));
 }
 
-template <typename TKey, typename TValue>
-bool LruCache<TKey, TValue>::TryTake(const TKey& key, TValue* dest) {
-  for (size_t i = 0; i < entries_.size(); ++i) {
-    if (entries_[i].key == key) {
-      if (dest)
-        *dest = entries_[i].value;
-      entries_.erase(entries_.begin() + i);
-      return true;
-    }
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+template <typename TAllocator>
+TValue ConcurrentLruCache<TKey, TValue, THash, kShards>::Get(
+    const TKey& key,
+    TAllocator allocator) {
+  Shard& shard = ShardFor(key);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    TValue value;
+    if (shard.cache.TryGet(key, &value))
+      return value;
   }
+  auto result = allocator();
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.cache.Insert(key, result);
+  return result;
+}
+
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+bool ConcurrentLruCache<TKey, TValue, THash, kShards>::Has(const TKey& key) {
+  Shard& shard = ShardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.cache.Has(key);
+}
 
-  return false;
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+bool ConcurrentLruCache<TKey, TValue, THash, kShards>::TryGet(const TKey& key,
+                                                              TValue* dest) {
+  Shard& shard = ShardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.cache.TryGet(key, dest);
 }
 
-template <typename TKey, typename TValue>
-void LruCache<TKey, TValue>::Insert(const TKey& key, const TValue& value) {
-  if ((int)entries_.size() >= max_entries_)
-    entries_.erase(std::min_element(entries_.begin(), entries_.end()));
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+bool ConcurrentLruCache<TKey, TValue, THash, kShards>::TryTake(const TKey& key,
+                                                               TValue* dest) {
+  Shard& shard = ShardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.cache.TryTake(key, dest);
+}
 
-  Entry entry;
-  entry.score = next_score_;
-  IncrementScore();
-  entry.key = key;
-  entry.value = value;
-  entries_.push_back(entry);
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+void ConcurrentLruCache<TKey, TValue, THash, kShards>::Insert(
+    const TKey& key,
+    const TValue& value) {
+  Shard& shard = ShardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.cache.Insert(key, value);
 }
 
-template <typename TKey, typename TValue>
+template <typename TKey, typename TValue, typename THash, size_t kShards>
 template <typename TFunc>
-void LruCache<TKey, TValue>::IterateValues(TFunc func) {
-  for (Entry& entry : entries_) {
-    if (!func(entry.value))
+void ConcurrentLruCache<TKey, TValue, THash, kShards>::IterateValues(
+    TFunc func) {
+  bool keep_going = true;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    shard->cache.IterateValues([&](TValue& value) {
+      keep_going = func(value);
+      return keep_going;
+    });
+    if (!keep_going)
       break;
   }
 }
 
-template <typename TKey, typename TValue>
-void LruCache<TKey, TValue>::IncrementScore() {
-  // Overflow.
-  if (++next_score_ == 0) {
-    std::sort(entries_.begin(), entries_.end());
-    for (Entry& entry : entries_)
-      entry.score = next_score_++;
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+size_t ConcurrentLruCache<TKey, TValue, THash, kShards>::TrimTo(
+    size_t max_bytes) {
+  size_t released = 0;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    released += shard->cache.TrimTo(max_bytes / kShards);
   }
+  return released;
 }
 
-template <typename TKey, typename TValue>
-void LruCache<TKey, TValue>::Clear(void) {
-  entries_.clear();
-  next_score_ = 0;
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+void ConcurrentLruCache<TKey, TValue, THash, kShards>::Clear(void) {
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    shard->cache.Clear();
+  }
+}
+
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+size_t ConcurrentLruCache<TKey, TValue, THash, kShards>::size() {
+  size_t total = 0;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    total += shard->cache.size();
+  }
+  return total;
+}
+
+template <typename TKey, typename TValue, typename THash, size_t kShards>
+size_t ConcurrentLruCache<TKey, TValue, THash, kShards>::bytes() {
+  size_t total = 0;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    total += shard->cache.bytes();
+  }
+  return total;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "LibLsp/JsonRpc/serializer.h"
+#include <memory>
 #include <string>
 #include "LibLsp/JsonRpc/message.h"
 namespace lsp
@@ -21,6 +22,8 @@ namespace lsp
 
 
 
+                // Reflects straight from the held JSON value; false if the
+                // text set by SetJsonString() is not valid JSON.
                 template <typename  T>
                 bool Get(T& value);
 
@@ -36,10 +39,9 @@ namespace lsp
 
                 void SetJsonString(const std::string& _data, Type _type);
 
-                const std::string& Data()const
-                {
-                        return  data;
-                }
+                // Serialized on first use when the value came from a parsed
+                // message.
+                const std::string& Data()const;
 
                 void swap(Any& arg) noexcept;
 
@@ -65,12 +67,28 @@ namespace lsp
                 bool GetForMapHelper(T& value);
                 bool GetForMapHelper(std::string& value);
                 bool GetForMapHelper(optional<std::string>& value);
+
+                // Like GetForMapHelper, for a member read straight from |visitor|.
+                template <typename  T>
+                static void GetForMapHelper(Reader& visitor, T& value);
+                static void GetForMapHelper(Reader& visitor, std::string& value);
+                static void GetForMapHelper(Reader& visitor, optional<std::string>& value);
         private:
+                friend struct AnyAccess;
+                // The value copied out of the source document into an arena of
+                // its own. Never modified once built, so copies of an Any share
+                // it.
+                struct Dom;
+
                 std::unique_ptr<Reader> GetReader();
                 std::unique_ptr<Writer> GetWriter() const;
                 void SetData(std::unique_ptr<Writer>&);
+                // Parses |data| into |dom| if there is no DOM yet.
+                bool Materialize();
 
+                // Either may be empty while the other is set.
                 std::string  data;
+                std::shared_ptr<const Dom> dom;
                 int jsonType = kUnKnown;
 
         };
@@ -102,6 +120,24 @@ void ReflectMember(std::map < std::string, std::string>& visitor, const char* na
         }
 }
 
+namespace lsp
+{
+        // Visitor handed to ReflectMap by Any::GetFromMap. Members are looked up
+        // in the JSON object directly.
+        struct AnyMapVisitor
+        {
+                Reader& reader;
+        };
+}
+
+template <typename T>
+void ReflectMember(lsp::AnyMapVisitor& visitor, const char* name, T& value) {
+        if (!visitor.reader.HasMember(name))
+                return;
+        auto member = visitor.reader[name];
+        lsp::Any::GetForMapHelper(*member, value);
+}
+
 #define REFLECT_MAP_TO_STRUCT(type, ...)               \
   template <typename TVisitor>                       \
   void ReflectMap(TVisitor& visitor, type& value) {     \
@@ -115,6 +151,8 @@ namespace lsp
         bool Any::Get(T& value)
         {
                 const auto visitor = GetReader();
+                if (!visitor)
+                        return false;
                 Reflect(*visitor, value);
                 return true;
         }
@@ -131,9 +169,10 @@ namespace lsp
         bool Any::GetFromMap(T& value)
         {
                 const auto visitor = GetReader();
-                std::map < std::string, lsp::Any> _temp;
-                Reflect(*visitor, _temp);
-                ReflectMap(_temp, value);
+                if (!visitor)
+                        return false;
+                AnyMapVisitor map{ *visitor };
+                ReflectMap(map, value);
                 return true;
         }
 
@@ -143,12 +182,12 @@ namespace lsp
                 jsonType = GetType();
                 if (jsonType == kStringType)
                 {
-                        auto copy = data;
-                        copy.erase(copy.find_last_not_of('"') + 1);
-                        copy.erase(0, copy.find_first_not_of('"'));
-                        lsp::Any any;
-                        any.SetJsonString(copy, kUnKnown);
-                        any.Get(value);
+                        // Through a reader rather than |data|, which is empty for
+                        // an Any that holds a DOM node.
+                        const auto visitor = GetReader();
+                        if (!visitor)
+                                return false;
+                        GetForMapHelper(*visitor, value);
                 }
                 else
                 {
@@ -156,4 +195,21 @@ namespace lsp
                 }
                 return true;
         }
+
+        template <typename T>
+        void Any::GetForMapHelper(Reader& visitor, T& value)
+        {
+                // Maps of options often carry every value as a string, e.g.
+                // "verbose": "true"; those are parsed again as JSON.
+                if (visitor.IsString())
+                {
+                        lsp::Any any;
+                        any.SetJsonString(visitor.GetString(), kUnKnown);
+                        any.Get(value);
+                }
+                else
+                {
+                        Reflect(visitor, value);
+                }
+        }
 }
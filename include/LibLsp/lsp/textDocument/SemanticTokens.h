@@ -3,6 +3,7 @@
 #include "LibLsp/lsp/lsTextDocumentIdentifier.h"
 #include "LibLsp/lsp/lsVersionedTextDocumentIdentifier.h"
 #include "LibLsp/JsonRpc/RequestInMessage.h"
+#include <memory>
 enum class HighlightingKind_clangD {
         Variable = 0,
         LocalVariable,
@@ -193,6 +194,14 @@ struct  SemanticTokens{
         std::vector<int32_t> data;
         static std::vector<int32_t> encodeTokens(std::vector<SemanticToken>& tokens);
 
+        /// Alternative to |data| for servers that build SemanticToken lists:
+        /// when |data| is empty these are written as the "data" array directly,
+        /// without an encodeTokens() copy. Never filled in when reading.
+        std::vector<SemanticToken> tokens;
+        /// Like |tokens|, for a list that is also held elsewhere, e.g. by
+        /// SemanticTokensCache. Written only when |data| and |tokens| are empty.
+        std::shared_ptr<const std::vector<SemanticToken>> shared_tokens;
+
         /**
          * An optional result id. If provided and clients support delta updating
          * the client will include the result id in the next semantic token request.
@@ -200,9 +209,12 @@ struct  SemanticTokens{
          * send a delta.
          */
    optional<std::string> resultId;
-   MAKE_SWAP_METHOD(SemanticTokens, data, resultId)
+   MAKE_SWAP_METHOD(SemanticTokens, data, tokens, shared_tokens, resultId)
 };
 MAKE_REFLECT_STRUCT(SemanticTokens, data, resultId)
+void Reflect(Writer& visitor, SemanticTokens& value);
+/// Writes |tokens| as the flat integer array LSP expects.
+void ReflectSemanticTokens(Writer& visitor, const std::vector<SemanticToken>& tokens);
 
 /// Body of textDocument/semanticTokens/full request.
 struct SemanticTokensParams {
@@ -235,11 +247,12 @@ struct SemanticTokensEdit {
         // We use token counts instead, and translate when serializing this struct.
         unsigned startToken = 0;
         unsigned deleteTokens = 0;
-        std::vector<int32_t> tokens; // encoded as a flat integer array
+        std::vector<int32_t> tokens; // encoded as a flat integer array, sent as `data`
 
-        MAKE_REFLECT_STRUCT(SemanticTokensEdit, startToken, deleteTokens, tokens)
+        MAKE_SWAP_METHOD(SemanticTokensEdit, startToken, deleteTokens, tokens)
 };
-MAKE_REFLECT_STRUCT(SemanticTokensEdit, startToken, deleteTokens, tokens)
+void Reflect(Reader& visitor, SemanticTokensEdit& value);
+void Reflect(Writer& visitor, SemanticTokensEdit& value);
 
 
 /// This models LSP SemanticTokensDelta | SemanticTokens, which is the result of
@@ -249,11 +262,25 @@ struct SemanticTokensOrDelta {
         /// Set if we computed edits relative to a previous set of tokens.
         optional< std::vector<SemanticTokensEdit> > edits;
         /// Set if we computed a fresh set of tokens.
-        /// Set if we computed edits relative to a previous set of tokens.
-        optional<std::vector<int32_t>> tokens; // encoded as integer array
-        MAKE_REFLECT_STRUCT(SemanticTokensOrDelta, resultId, edits, tokens)
+        optional<std::vector<int32_t>> tokens; // encoded as integer array, sent as `data`
+        MAKE_SWAP_METHOD(SemanticTokensOrDelta, resultId, edits, tokens)
 };
-MAKE_REFLECT_STRUCT(SemanticTokensOrDelta, resultId, edits, tokens)
+template <typename TVisitor>
+void Reflect(TVisitor& visitor, SemanticTokensOrDelta& value)
+{
+        REFLECT_MEMBER_START();
+        REFLECT_MEMBER(resultId);
+        REFLECT_MEMBER(edits);
+        REFLECT_MEMBER2("data", value.tokens);
+        REFLECT_MEMBER_END();
+}
+
+/// Computes edits that turn |old_tokens| into |new_tokens|. Common leading and
+/// trailing tokens are trimmed first; what remains is diffed token by token,
+/// falling back to a single edit over the changed region when the two differ
+/// too much for separate edits to pay off.
+std::vector<SemanticTokensEdit> diffTokens(const std::vector<SemanticToken>& old_tokens,
+        const std::vector<SemanticToken>& new_tokens);
 
 
 struct SemanticTokensLegend {
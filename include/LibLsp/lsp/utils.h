@@ -9,6 +9,7 @@
 #include <vector>
 #include <optional>
 #include <LibLsp/lsp/AbsolutePath.h>
+#include "LibLsp/JsonRpc/stringViewVersion.h"
 
 #include "lsPosition.h"
 
@@ -80,8 +81,49 @@ std::string EscapeFileName(std::string path);
 
 // FIXME: Move ReadContent into ICacheManager?
 bool FileExists(const std::string& filename);
+// Reads the whole file with a single allocation sized from the file size.
 optional<std::string> ReadContent(const AbsolutePath& filename);
 std::vector<std::string> ReadLinesWithEnding(const AbsolutePath& filename);
+// Reads all |filenames| using up to |threads| threads (0 picks the hardware
+// concurrency). The result is in the same order as |filenames|.
+std::vector<optional<std::string>> ReadContents(const std::vector<AbsolutePath>& filenames,
+                                                unsigned threads = 0);
+
+// Read-only memory mapping of a file, for consumers that only need to scan the
+// content and would otherwise copy it into a std::string. Files that report a
+// size of 0 (empty files, but also procfs entries, FIFOs and some FUSE mounts)
+// cannot be mapped and are read into memory instead.
+//
+// The mapping is not a snapshot: if another process truncates the file while
+// it is mapped, as editors do when saving, touching the lost pages raises
+// SIGBUS. Only use it for files nobody else writes to; ReadContent() is the
+// safe default.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const AbsolutePath& filename);
+  void Close();
+
+  bool IsOpen() const { return open_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  // Valid until the MappedFile is closed or destroyed.
+  string_view View() const { return string_view(data_ ? data_ : "", size_); }
+
+ private:
+  // Points into the mapping, or into |owned_|.
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool open_ = false;
+  bool mapped_ = false;
+  std::string owned_;
+};
 
 bool WriteToFile(const std::string& filename, const std::string& content);
 
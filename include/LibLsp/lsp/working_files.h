@@ -9,6 +9,7 @@
 #include <string>
 #include <memory>
 #include "Directory.h"
+#include "AsyncFileWriter.h"
 
 struct WorkingFiles;
 struct WorkingFilesData;
@@ -19,6 +20,8 @@ struct WorkingFile {
     Directory directory;
     WorkingFiles& parent;
     std::atomic<long long> counter;
+    // Interned id of |filename|, used as the key in WorkingFiles.
+    uint32_t path_id = 0;
     WorkingFile(WorkingFiles& ,const AbsolutePath& filename, const std::string& buffer_content);
     WorkingFile(WorkingFiles&, const AbsolutePath& filename, std::string&& buffer_content);
     const std::string&  GetContentNoLock() const
@@ -39,7 +42,15 @@ struct WorkingFiles {
   std::shared_ptr<WorkingFile>  OnOpen(lsTextDocumentItem& open);
   std::shared_ptr<WorkingFile>  OnChange(const lsTextDocumentDidChangeParams& change);
   bool  OnClose(const lsTextDocumentIdentifier& close);
+  // Persists the buffer like OnSaveAsync and waits until it is written.
   std::shared_ptr<WorkingFile>  OnSave(const lsTextDocumentIdentifier& _save);
+  // Snapshots the buffer and queues it for an atomic write. The future
+  // resolves to false if the file is not open or the write failed.
+  lsp::future<bool>  OnSaveAsync(const lsTextDocumentIdentifier& _save);
+
+  void SetFsyncPolicy(lsp::FsyncPolicy policy);
+  // Blocks until every queued save has reached the disk.
+  void FlushSaves();
 
   bool GetFileBufferContent(const AbsolutePath& filename, std::wstring& out)
   {
@@ -64,7 +75,7 @@ struct WorkingFiles {
 
   void Clear();
 private:
-  std::shared_ptr<WorkingFile>  GetFileByFilenameNoLock(const AbsolutePath& filename);
+  lsp::future<bool>  Save(const lsTextDocumentIdentifier& _save, std::shared_ptr<WorkingFile>& file);
 
   WorkingFilesData* d_ptr;
 
@@ -0,0 +1,120 @@
+#include "LibLsp/JsonRpc/AdmissionController.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace lsp
+{
+namespace
+{
+        // The newest sample has a weight of 1 / kSmoothing.
+        constexpr int64_t kSmoothing = 8;
+
+        // Racy on purpose: two samples landing together may lose one, which an
+        // average over recent runs can afford.
+        void Smooth(std::atomic<int64_t>& average, int64_t sample)
+        {
+                const int64_t old = average.load(std::memory_order_relaxed);
+                average.store(old ? old + (sample - old) / kSmoothing : std::max<int64_t>(sample, 1),
+                        std::memory_order_relaxed);
+        }
+}
+
+struct AdmissionController::Data
+{
+        explicit Data(unsigned _workers) : workers(std::max(_workers, 1u))
+        {
+        }
+
+        // Microseconds, 0 until the first run.
+        std::atomic<int64_t>* AverageOf(MethodId method) const
+        {
+                return method < method_count.load(std::memory_order_acquire) ? &averages[method] : nullptr;
+        }
+
+        const unsigned workers;
+        std::atomic<int64_t> budget_us{ 0 };
+
+        // Indexed by MethodId; published by |method_count|.
+        std::unique_ptr<std::atomic<int64_t>[]> averages;
+        std::atomic<size_t> method_count{ 0 };
+        std::atomic<int64_t> overall_us{ 0 };
+
+        // Expected cost of the handlers running now, and how many there are.
+        std::atomic<int64_t> running_us{ 0 };
+        std::atomic<unsigned> running{ 0 };
+};
+
+AdmissionController::AdmissionController(unsigned workers) : d_ptr(new Data(workers))
+{
+}
+
+AdmissionController::~AdmissionController()
+{
+        delete d_ptr;
+}
+
+void AdmissionController::Reserve(size_t method_count)
+{
+        if (d_ptr->averages)
+                return;
+        d_ptr->averages.reset(new std::atomic<int64_t>[method_count + 1]);
+        for (size_t i = 0; i <= method_count; ++i)
+                d_ptr->averages[i].store(0, std::memory_order_relaxed);
+        d_ptr->method_count.store(method_count + 1, std::memory_order_release);
+}
+
+void AdmissionController::SetBudget(std::chrono::milliseconds budget)
+{
+        d_ptr->budget_us.store(std::chrono::duration_cast<std::chrono::microseconds>(budget).count(),
+                std::memory_order_relaxed);
+}
+
+std::chrono::milliseconds AdmissionController::GetBudget() const
+{
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::microseconds(d_ptr->budget_us.load(std::memory_order_relaxed)));
+}
+
+int64_t AdmissionController::Started(MethodId method)
+{
+        const auto* average = d_ptr->AverageOf(method);
+        int64_t expected = average ? average->load(std::memory_order_relaxed) : 0;
+        if (!expected)
+                expected = d_ptr->overall_us.load(std::memory_order_relaxed);
+        d_ptr->running.fetch_add(1, std::memory_order_relaxed);
+        d_ptr->running_us.fetch_add(expected, std::memory_order_relaxed);
+        return expected;
+}
+
+void AdmissionController::Finished(MethodId method, int64_t expected, std::chrono::steady_clock::duration took)
+{
+        d_ptr->running_us.fetch_sub(expected, std::memory_order_relaxed);
+        d_ptr->running.fetch_sub(1, std::memory_order_relaxed);
+
+        const int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(took).count();
+        if (auto* average = d_ptr->AverageOf(method))
+                Smooth(*average, sample);
+        Smooth(d_ptr->overall_us, sample);
+}
+
+std::chrono::microseconds AdmissionController::EstimatedWait(size_t queued) const
+{
+        // A worker is free right away.
+        if (queued + d_ptr->running.load(std::memory_order_relaxed) < d_ptr->workers)
+                return std::chrono::microseconds(0);
+        // Queued messages are not parsed yet, so each is taken to cost the
+        // average over all methods.
+        const int64_t backlog = static_cast<int64_t>(queued) * d_ptr->overall_us.load(std::memory_order_relaxed)
+                + std::max<int64_t>(d_ptr->running_us.load(std::memory_order_relaxed), 0);
+        return std::chrono::microseconds(backlog / d_ptr->workers);
+}
+
+bool AdmissionController::OverBudget(size_t queued) const
+{
+        const int64_t budget = d_ptr->budget_us.load(std::memory_order_relaxed);
+        return budget > 0 && EstimatedWait(queued).count() > budget;
+}
+
+}
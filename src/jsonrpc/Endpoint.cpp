@@ -1,14 +1,24 @@
 #include "LibLsp/JsonRpc/Endpoint.h"
 #include "LibLsp/JsonRpc/message.h"
 
+namespace
+{
+        template <typename T>
+        const T* FindHandler(const lsp::MethodSlots<T>& slots, const LspMessage& msg, const char* method)
+        {
+                if (msg.method_id != lsp::kInvalidMethodId)
+                        return slots.Find(msg.method_id);
+                return slots.Find(method);
+        }
+}
 
 bool GenericEndpoint::notify(std::unique_ptr<LspMessage> msg)
 {
-        auto findIt = method2notification.find(msg->GetMethodType());
+        const auto handler = FindHandler(method2notification, *msg, msg->GetMethodType());
 
-        if (findIt != method2notification.end())
+        if (handler)
         {
-                return  findIt->second(std::move(msg));
+                return  (*handler)(std::move(msg));
         }
         std::string info = "can't find method2notification for notification:\n" + msg->ToJson() + "\n";
         log.log(lsp::Log::Level::SEVERE, info);
@@ -17,11 +27,11 @@ bool GenericEndpoint::notify(std::unique_ptr<LspMessage> msg)
 
 bool GenericEndpoint::onResponse(const std::string& method, std::unique_ptr<LspMessage>msg)
 {
-        auto findIt = method2response.find(method);
+        const auto handler = FindHandler(method2response, *msg, method.c_str());
 
-        if (findIt != method2response.end())
+        if (handler)
         {
-                return  findIt->second(std::move(msg));
+                return  (*handler)(std::move(msg));
         }
 
         std::string info = "can't find method2response for response:\n" + msg->ToJson() + "\n";
@@ -34,11 +44,11 @@ bool GenericEndpoint::onResponse(const std::string& method, std::unique_ptr<LspM
 
 bool GenericEndpoint::onRequest(std::unique_ptr<LspMessage> request)
 {
-        auto findIt = method2request.find(request->GetMethodType());
+        const auto handler = FindHandler(method2request, *request, request->GetMethodType());
 
-        if (findIt != method2request.end())
+        if (handler)
         {
-                return  findIt->second(std::move(request));
+                return  (*handler)(std::move(request));
         }
         std::string info = "can't find method2request for request:\n" + request->ToJson() + "\n";
         log.log(lsp::Log::Level::SEVERE, info);
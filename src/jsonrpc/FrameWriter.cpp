@@ -0,0 +1,283 @@
+#include "LibLsp/JsonRpc/FrameWriter.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "LibLsp/JsonRpc/MemoryBudget.h"
+#include "LibLsp/JsonRpc/stream.h"
+
+namespace lsp
+{
+namespace
+{
+        // One write and one flush carry at most this much, so a burst of
+        // output cannot keep the first frame of the burst from the client.
+        constexpr size_t kMaxBatchFrames = 64;
+        constexpr size_t kMaxBatchBytes = 1024 * 1024;
+
+        struct Node
+        {
+                Node() = default;
+                explicit Node(std::string&& _frame) : frame(std::move(_frame))
+                {
+                }
+
+                std::atomic<Node*> next{ nullptr };
+                std::string frame;
+        };
+}
+
+constexpr size_t FrameWriter::kDefaultMaxQueuedBytes;
+
+struct FrameWriter::Data
+{
+        explicit Data(size_t max_bytes) : max_queued_bytes(max_bytes), head(new Node()), tail(head.load())
+        {
+        }
+
+        ~Data()
+        {
+                while (tail)
+                {
+                        Node* next = tail->next.load(std::memory_order_relaxed);
+                        delete tail;
+                        tail = next;
+                }
+        }
+
+        // Multi-producer, single-consumer queue of nodes: producers swap
+        // themselves in at |head| and then link the previous node to them;
+        // the writer thread follows the links from |tail|, which is always a
+        // node whose frame has already been taken.
+        void Enqueue(Node* node)
+        {
+                Node* prev = head.exchange(node, std::memory_order_acq_rel);
+                // Ordered with the load of |sleeping| below, and the writer's
+                // store to it before it looks at the queue a last time.
+                prev->next.store(node, std::memory_order_seq_cst);
+                if (sleeping.load(std::memory_order_seq_cst))
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        cv.notify_one();
+                }
+        }
+
+        bool HasFrames() const
+        {
+                return tail->next.load(std::memory_order_seq_cst) != nullptr;
+        }
+
+        size_t TakeBatch(std::vector<std::string>& batch)
+        {
+                size_t bytes = 0;
+                while (batch.size() < kMaxBatchFrames && bytes < kMaxBatchBytes)
+                {
+                        Node* next = tail->next.load(std::memory_order_acquire);
+                        if (!next)
+                                break;
+                        batch.push_back(std::move(next->frame));
+                        bytes += batch.back().size();
+                        delete tail;
+                        tail = next;
+                }
+                return bytes;
+        }
+
+        void Write(const std::vector<std::string>& batch)
+        {
+                if (failed.load(std::memory_order_relaxed))
+                        return;
+                buffers.clear();
+                for (const auto& frame : batch)
+                        buffers.push_back({ frame.data(), frame.size() });
+                // Every write to a message-oriented stream is one message, and
+                // each frame has to arrive as a message of its own.
+                if (output->is_message_oriented())
+                {
+                        for (const auto& buffer : buffers)
+                                output->write(&buffer, 1);
+                }
+                else
+                {
+                        output->write(buffers.data(), buffers.size());
+                }
+                output->flush();
+                if (output->bad())
+                        failed.store(true, std::memory_order_relaxed);
+        }
+
+        void Release(size_t bytes)
+        {
+                queued_bytes.fetch_sub(bytes, std::memory_order_seq_cst);
+                memory->Add(-static_cast<int64_t>(bytes));
+                if (blocked.load(std::memory_order_seq_cst))
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        space_cv.notify_all();
+                }
+        }
+
+        void Run()
+        {
+                std::vector<std::string> batch;
+                for (;;)
+                {
+                        batch.clear();
+                        const size_t bytes = TakeBatch(batch);
+                        if (!batch.empty())
+                        {
+                                Write(batch);
+                                Release(bytes);
+                                continue;
+                        }
+
+                        std::unique_lock<std::mutex> lock(mutex);
+                        sleeping.store(true, std::memory_order_seq_cst);
+                        cv.wait(lock, [this] { return HasFrames() || stopping.load(std::memory_order_relaxed); });
+                        sleeping.store(false, std::memory_order_relaxed);
+                        if (!HasFrames())
+                                return;
+                }
+        }
+
+        // Returns false if the writer stopped while waiting.
+        bool WaitForSpace()
+        {
+                std::unique_lock<std::mutex> lock(mutex);
+                blocked.fetch_add(1, std::memory_order_seq_cst);
+                space_cv.wait(lock, [this]
+                        {
+                                return queued_bytes.load(std::memory_order_seq_cst) <= max_queued_bytes.load(std::memory_order_relaxed)
+                                        || stopping.load(std::memory_order_relaxed);
+                        });
+                blocked.fetch_sub(1, std::memory_order_relaxed);
+                return !stopping.load(std::memory_order_relaxed);
+        }
+
+        std::atomic<size_t> max_queued_bytes;
+        std::atomic<size_t> queued_bytes{ 0 };
+
+        std::atomic<Node*> head;
+        // Only touched by the writer thread, and by the destructor.
+        Node* tail;
+
+        // |sleeping| is set while the writer waits on |cv| for frames, and
+        // |blocked| counts pushes waiting on |space_cv| for the queue to drain.
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::condition_variable space_cv;
+        std::atomic<bool> sleeping{ false };
+        std::atomic<unsigned> blocked{ 0 };
+        std::atomic<bool> stopping{ true };
+        std::atomic<bool> failed{ false };
+        // Pushes between their check of |stopping| and the end of their
+        // Enqueue(); Stop() waits for them before it drains the queue.
+        std::atomic<unsigned> pushing{ 0 };
+
+        std::shared_ptr<ostream> output;
+        std::vector<const_buffer> buffers;
+        // Serializes Start() and Stop().
+        std::mutex lifecycle_mutex;
+        std::thread writer;
+
+        std::unique_ptr<MemoryBudget::Consumer> memory = MemoryBudget::Global().Register("send_queue");
+};
+
+FrameWriter::FrameWriter(size_t max_queued_bytes) : d_ptr(new Data(max_queued_bytes))
+{
+}
+
+FrameWriter::~FrameWriter()
+{
+        Stop();
+        delete d_ptr;
+}
+
+void FrameWriter::Start(std::shared_ptr<ostream> output)
+{
+        std::lock_guard<std::mutex> lifecycle_lock(d_ptr->lifecycle_mutex);
+        if (d_ptr->writer.joinable())
+                return;
+        d_ptr->output = std::move(output);
+        d_ptr->failed.store(!d_ptr->output, std::memory_order_relaxed);
+        d_ptr->stopping.store(false, std::memory_order_release);
+        d_ptr->writer = std::thread([this] { d_ptr->Run(); });
+}
+
+void FrameWriter::Stop()
+{
+        std::lock_guard<std::mutex> lifecycle_lock(d_ptr->lifecycle_mutex);
+        if (!d_ptr->writer.joinable())
+                return;
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                d_ptr->stopping.store(true, std::memory_order_seq_cst);
+        }
+        d_ptr->cv.notify_all();
+        d_ptr->space_cv.notify_all();
+        d_ptr->writer.join();
+
+        // A push that saw |stopping| unset may link its frame after Run() had
+        // found the queue empty. Every push still under way sees it set from
+        // now on; wait for those that did not, and write what they queued.
+        while (d_ptr->pushing.load(std::memory_order_seq_cst))
+                std::this_thread::yield();
+        std::vector<std::string> batch;
+        for (;;)
+        {
+                const size_t bytes = d_ptr->TakeBatch(batch);
+                if (batch.empty())
+                        break;
+                d_ptr->Write(batch);
+                d_ptr->Release(bytes);
+                batch.clear();
+        }
+        d_ptr->output.reset();
+}
+
+bool FrameWriter::Push(std::string&& frame)
+{
+        struct Pushing
+        {
+                explicit Pushing(std::atomic<unsigned>& _count) : count(_count)
+                {
+                        count.fetch_add(1, std::memory_order_seq_cst);
+                }
+                ~Pushing()
+                {
+                        count.fetch_sub(1, std::memory_order_seq_cst);
+                }
+                std::atomic<unsigned>& count;
+        } pushing(d_ptr->pushing);
+
+        if (d_ptr->stopping.load(std::memory_order_seq_cst) || d_ptr->failed.load(std::memory_order_relaxed))
+                return false;
+        if (d_ptr->queued_bytes.load(std::memory_order_relaxed) > d_ptr->max_queued_bytes.load(std::memory_order_relaxed)
+                && !d_ptr->WaitForSpace())
+                return false;
+
+        const size_t size = frame.size();
+        d_ptr->queued_bytes.fetch_add(size, std::memory_order_relaxed);
+        d_ptr->memory->Add(static_cast<int64_t>(size));
+        d_ptr->Enqueue(new Node(std::move(frame)));
+        return true;
+}
+
+void FrameWriter::SetMaxQueuedBytes(size_t bytes)
+{
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                d_ptr->max_queued_bytes.store(bytes, std::memory_order_relaxed);
+        }
+        d_ptr->space_cv.notify_all();
+}
+
+size_t FrameWriter::queued_bytes() const
+{
+        return d_ptr->queued_bytes.load(std::memory_order_relaxed);
+}
+
+}
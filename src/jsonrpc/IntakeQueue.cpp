@@ -0,0 +1,162 @@
+#include "LibLsp/JsonRpc/IntakeQueue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "LibLsp/JsonRpc/MemoryBudget.h"
+#include "LibLsp/JsonRpc/Metrics.h"
+
+namespace lsp
+{
+struct IntakeQueue::Data
+{
+        explicit Data(const std::string& name)
+                : memory(MemoryBudget::Global().Register(name)),
+                  blocked(Metrics::Global().GetCounter(memory->name() + ".blocked"))
+        {
+                auto& metrics = Metrics::Global();
+                depth_gauge = metrics.AddGauge(memory->name() + ".depth", [this] {
+                        return static_cast<int64_t>(depth.load(std::memory_order_relaxed));
+                });
+                bytes_gauge = metrics.AddGauge(memory->name() + ".bytes", [this] {
+                        return static_cast<int64_t>(bytes.load(std::memory_order_relaxed));
+                });
+        }
+
+        ~Data()
+        {
+                Metrics::Global().RemoveGauge(depth_gauge);
+                Metrics::Global().RemoveGauge(bytes_gauge);
+        }
+
+        // Called with |mutex| held.
+        bool Fits(size_t size) const
+        {
+                if (messages.empty())
+                        return true;
+                return messages.size() < limits.max_messages && bytes.load(std::memory_order_relaxed) + size <= limits.max_bytes;
+        }
+
+        // Called with |mutex| held.
+        void Append(std::string&& message)
+        {
+                const size_t size = message.size();
+                messages.push_back(std::move(message));
+                depth.store(messages.size(), std::memory_order_relaxed);
+                bytes.fetch_add(size, std::memory_order_relaxed);
+                memory->Add(static_cast<int64_t>(size));
+        }
+
+        mutable std::mutex mutex;
+        std::condition_variable space_cv;
+        std::deque<std::string> messages;
+        Limits limits;
+        bool closed = false;
+
+        // Mirrors of |messages| for the gauges, which must not take |mutex|.
+        std::atomic<size_t> depth{ 0 };
+        std::atomic<size_t> bytes{ 0 };
+
+        // Declared before the metrics, which are named after it.
+        std::unique_ptr<MemoryBudget::Consumer> memory;
+        Metrics::Counter& blocked;
+        Metrics::GaugeId depth_gauge = 0;
+        Metrics::GaugeId bytes_gauge = 0;
+};
+
+IntakeQueue::IntakeQueue(const std::string& name) : d_ptr(new Data(name))
+{
+}
+
+IntakeQueue::~IntakeQueue()
+{
+        delete d_ptr;
+}
+
+bool IntakeQueue::Push(std::string&& message)
+{
+        std::unique_lock<std::mutex> lock(d_ptr->mutex);
+        if (!d_ptr->closed && !d_ptr->Fits(message.size()))
+        {
+                d_ptr->blocked.Add();
+                d_ptr->space_cv.wait(lock, [&] { return d_ptr->closed || d_ptr->Fits(message.size()); });
+        }
+        if (d_ptr->closed)
+                return false;
+        d_ptr->Append(std::move(message));
+        return true;
+}
+
+bool IntakeQueue::TryPush(std::string& message)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        if (d_ptr->closed || !d_ptr->Fits(message.size()))
+                return false;
+        d_ptr->Append(std::move(message));
+        return true;
+}
+
+bool IntakeQueue::TryPop(std::string& message)
+{
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                if (d_ptr->messages.empty())
+                        return false;
+                message = std::move(d_ptr->messages.front());
+                d_ptr->messages.pop_front();
+                d_ptr->depth.store(d_ptr->messages.size(), std::memory_order_relaxed);
+                d_ptr->bytes.fetch_sub(message.size(), std::memory_order_relaxed);
+                d_ptr->memory->Add(-static_cast<int64_t>(message.size()));
+        }
+        d_ptr->space_cv.notify_one();
+        return true;
+}
+
+void IntakeQueue::Close()
+{
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                d_ptr->closed = true;
+                d_ptr->messages.clear();
+                d_ptr->depth.store(0, std::memory_order_relaxed);
+                d_ptr->bytes.store(0, std::memory_order_relaxed);
+                d_ptr->memory->Set(0);
+        }
+        d_ptr->space_cv.notify_all();
+}
+
+void IntakeQueue::Open()
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        d_ptr->closed = false;
+}
+
+void IntakeQueue::SetLimits(const Limits& limits)
+{
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                d_ptr->limits = limits;
+        }
+        d_ptr->space_cv.notify_all();
+}
+
+IntakeQueue::Limits IntakeQueue::GetLimits() const
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        return d_ptr->limits;
+}
+
+size_t IntakeQueue::depth() const
+{
+        return d_ptr->depth.load(std::memory_order_relaxed);
+}
+
+size_t IntakeQueue::bytes() const
+{
+        return d_ptr->bytes.load(std::memory_order_relaxed);
+}
+
+}
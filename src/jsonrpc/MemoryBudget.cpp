@@ -0,0 +1,243 @@
+#include "LibLsp/JsonRpc/MemoryBudget.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+
+#include "LibLsp/JsonRpc/Metrics.h"
+#include "LibLsp/JsonRpc/TimerWheel.h"
+
+namespace lsp
+{
+struct MemoryBudget::Data
+{
+        struct Entry
+        {
+                std::string name;
+                TrimCallback trim;
+                std::shared_ptr<std::atomic<size_t>> usage;
+                Metrics::GaugeId gauge = 0;
+        };
+
+        Metrics* metrics = nullptr;
+        std::vector<Metrics::GaugeId> gauges;
+
+        mutable std::mutex mutex;
+        // Held while trim callbacks run so their owners cannot unregister
+        // underneath them.
+        std::mutex reclaim_mutex;
+        std::unordered_map<uint64_t, Entry> entries;
+        uint64_t next_id = 1;
+        // Consumers registered so far under each name.
+        std::unordered_map<std::string, unsigned> instances;
+
+        std::atomic<int64_t> total{ 0 };
+        std::atomic<size_t> limit{ 0 };
+        std::atomic<bool> reclaim_scheduled{ false };
+        // Guarded by |mutex|; |reclaim_done| is signalled when a scheduled
+        // reclaim has finished.
+        TimerWheel::TimerId reclaim_timer = 0;
+        std::condition_variable reclaim_done;
+};
+
+MemoryBudget::Consumer::Consumer(MemoryBudget& budget, uint64_t id, std::string name,
+        std::shared_ptr<std::atomic<size_t>> usage)
+        : budget_(budget), id_(id), name_(std::move(name)), usage_(std::move(usage))
+{
+}
+
+MemoryBudget::Consumer::~Consumer()
+{
+        budget_.Unregister(id_);
+}
+
+void MemoryBudget::Consumer::Set(size_t bytes)
+{
+        const size_t old = usage_->exchange(bytes, std::memory_order_relaxed);
+        budget_.Update(static_cast<int64_t>(bytes) - static_cast<int64_t>(old));
+}
+
+void MemoryBudget::Consumer::Add(int64_t delta)
+{
+        usage_->fetch_add(static_cast<size_t>(delta), std::memory_order_relaxed);
+        budget_.Update(delta);
+}
+
+size_t MemoryBudget::Consumer::bytes() const
+{
+        return usage_->load(std::memory_order_relaxed);
+}
+
+MemoryBudget& MemoryBudget::Global()
+{
+        static MemoryBudget* budget = new MemoryBudget(&Metrics::Global());
+        return *budget;
+}
+
+MemoryBudget::MemoryBudget(Metrics* metrics) : d_ptr(new Data())
+{
+        d_ptr->metrics = metrics;
+        if (metrics)
+        {
+                d_ptr->gauges.push_back(metrics->AddGauge("memory.total_bytes", [this] {
+                        return static_cast<int64_t>(Total());
+                }));
+                d_ptr->gauges.push_back(metrics->AddGauge("memory.limit_bytes", [this] {
+                        return static_cast<int64_t>(GetLimit());
+                }));
+        }
+}
+
+MemoryBudget::~MemoryBudget()
+{
+        {
+                // A reclaim that is already running uses this budget; wait for it.
+                std::unique_lock<std::mutex> lock(d_ptr->mutex);
+                if (d_ptr->reclaim_timer && TimerWheel::Default().Cancel(d_ptr->reclaim_timer))
+                        d_ptr->reclaim_scheduled.store(false);
+                d_ptr->reclaim_done.wait(lock, [this] { return !d_ptr->reclaim_scheduled.load(); });
+        }
+        if (d_ptr->metrics)
+        {
+                for (auto id : d_ptr->gauges)
+                        d_ptr->metrics->RemoveGauge(id);
+        }
+        delete d_ptr;
+}
+
+std::unique_ptr<MemoryBudget::Consumer> MemoryBudget::Register(const std::string& name, TrimCallback trim)
+{
+        auto usage = std::make_shared<std::atomic<size_t>>(0);
+        uint64_t id;
+        std::string unique_name = name;
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                id = d_ptr->next_id++;
+                const unsigned instance = ++d_ptr->instances[name];
+                if (instance > 1)
+                        unique_name += "." + std::to_string(instance);
+                Data::Entry entry{ unique_name, std::move(trim), usage, 0 };
+                if (d_ptr->metrics)
+                {
+                        entry.gauge = d_ptr->metrics->AddGauge("memory." + unique_name + ".bytes", [usage] {
+                                return static_cast<int64_t>(usage->load(std::memory_order_relaxed));
+                        });
+                }
+                d_ptr->entries.emplace(id, std::move(entry));
+        }
+        return std::unique_ptr<Consumer>(new Consumer(*this, id, std::move(unique_name), std::move(usage)));
+}
+
+void MemoryBudget::Unregister(uint64_t id)
+{
+        Data::Entry entry;
+        {
+                std::lock_guard<std::mutex> reclaim_lock(d_ptr->reclaim_mutex);
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                const auto findIt = d_ptr->entries.find(id);
+                if (findIt == d_ptr->entries.end())
+                        return;
+                entry = std::move(findIt->second);
+                d_ptr->entries.erase(findIt);
+        }
+        if (d_ptr->metrics && entry.gauge)
+                d_ptr->metrics->RemoveGauge(entry.gauge);
+        Update(-static_cast<int64_t>(entry.usage->load(std::memory_order_relaxed)));
+}
+
+void MemoryBudget::Update(int64_t delta)
+{
+        d_ptr->total.fetch_add(delta, std::memory_order_relaxed);
+        if (delta > 0)
+                CheckPressure();
+}
+
+void MemoryBudget::CheckPressure()
+{
+        const size_t limit = GetLimit();
+        if (!limit || Total() <= limit)
+                return;
+        if (d_ptr->reclaim_scheduled.exchange(true))
+                return;
+        // Owners usually report while holding their own locks, and their trim
+        // callbacks take those locks again; reclaim on a worker of the default
+        // wheel's executor instead, which keeps the reactor thread free.
+        const auto timer = TimerWheel::Default().Schedule(std::chrono::milliseconds(0), [this] {
+                const size_t current_limit = GetLimit();
+                if (current_limit)
+                        Reclaim(current_limit / 10 * 9);
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                d_ptr->reclaim_timer = 0;
+                d_ptr->reclaim_scheduled.store(false);
+                d_ptr->reclaim_done.notify_all();
+        });
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        // The reclaim may have run already.
+        if (d_ptr->reclaim_scheduled.load())
+                d_ptr->reclaim_timer = timer;
+}
+
+void MemoryBudget::SetLimit(size_t bytes)
+{
+        d_ptr->limit.store(bytes, std::memory_order_relaxed);
+        CheckPressure();
+}
+
+size_t MemoryBudget::GetLimit() const
+{
+        return d_ptr->limit.load(std::memory_order_relaxed);
+}
+
+size_t MemoryBudget::Total() const
+{
+        const int64_t total = d_ptr->total.load(std::memory_order_relaxed);
+        return total > 0 ? static_cast<size_t>(total) : 0;
+}
+
+size_t MemoryBudget::Reclaim(size_t target)
+{
+        std::lock_guard<std::mutex> reclaim_lock(d_ptr->reclaim_mutex);
+        std::vector<std::pair<size_t, TrimCallback>> candidates;
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                for (auto& it : d_ptr->entries)
+                {
+                        if (it.second.trim)
+                                candidates.emplace_back(it.second.usage->load(std::memory_order_relaxed), it.second.trim);
+                }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                [](const std::pair<size_t, TrimCallback>& a, const std::pair<size_t, TrimCallback>& b)
+                {
+                        return a.first > b.first;
+                });
+
+        size_t released = 0;
+        for (auto& candidate : candidates)
+        {
+                const size_t total = Total();
+                if (total <= target)
+                        break;
+                released += candidate.second(total - target);
+        }
+        return released;
+}
+
+std::vector<std::pair<std::string, size_t>> MemoryBudget::Usage() const
+{
+        std::vector<std::pair<std::string, size_t>> usage;
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                for (auto& it : d_ptr->entries)
+                        usage.emplace_back(it.second.name, it.second.usage->load(std::memory_order_relaxed));
+        }
+        std::sort(usage.begin(), usage.end(),
+                [](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b)
+                {
+                        return a.second > b.second;
+                });
+        return usage;
+}
+
+}
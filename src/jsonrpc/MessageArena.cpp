@@ -0,0 +1,72 @@
+#include "LibLsp/JsonRpc/MessageArena.h"
+
+#include <vector>
+
+namespace lsp
+{
+namespace
+{
+        constexpr size_t kInitialValueBytes = 64 * 1024;
+        constexpr size_t kMaxValueBytes = 4 * 1024 * 1024;
+        constexpr size_t kStackBytes = 16 * 1024;
+}
+
+struct MessageArena::Buffers
+{
+        Buffers() : values(kInitialValueBytes), stack(kStackBytes)
+        {
+        }
+
+        std::vector<char> values;
+        std::vector<char> stack;
+        bool in_use = false;
+};
+
+MessageArena::Lease::Lease()
+{
+        thread_local std::unique_ptr<Buffers> t_buffers;
+        if (!t_buffers)
+                t_buffers.reset(new Buffers());
+        if (t_buffers->in_use)
+        {
+                own.reset(new Buffers());
+                buffers = own.get();
+        }
+        else
+        {
+                buffers = t_buffers.get();
+        }
+        buffers->in_use = true;
+}
+
+MessageArena::Lease::~Lease()
+{
+        buffers->in_use = false;
+        if (own || used <= buffers->values.size())
+                return;
+        // Size the buffer for a message like this one next time.
+        size_t size = buffers->values.size();
+        while (size < used && size < kMaxValueBytes)
+                size *= 2;
+        if (size > buffers->values.size())
+        {
+                buffers->values.clear();
+                buffers->values.shrink_to_fit();
+                buffers->values.resize(size);
+        }
+}
+
+MessageArena::MessageArena()
+        : values_(lease_.buffers->values.data(), lease_.buffers->values.size()),
+          stack_(lease_.buffers->stack.data(), lease_.buffers->stack.size()),
+          document_(&values_, 1024, &stack_)
+{
+}
+
+MessageArena::~MessageArena()
+{
+        // The pools and the document are destroyed after this, the lease last.
+        lease_.used = values_.Size();
+}
+
+}
@@ -6,52 +6,55 @@
 
 std::unique_ptr<LspMessage> MessageJsonHandler::parseResponseMessage(const std::string& method, Reader& r)
 {
-        auto findIt = method2response.find(method);
-
-        if( findIt != method2response.end())
-        {
-                return  findIt->second(r);
-        }
-        return nullptr;
+        return parseResponseMessage(lsp::MethodTable::Global().Find(method), r);
 }
 
 std::unique_ptr<LspMessage> MessageJsonHandler::parseRequstMessage(const std::string& method, Reader&r)
 {
-        auto findIt = method2request.find(method);
-
-        if (findIt != method2request.end())
-        {
-                return  findIt->second(r);
-        }
-        return nullptr;
+        return parseRequstMessage(lsp::MethodTable::Global().Find(method), r);
 }
 
 bool MessageJsonHandler::resovleResponseMessage(Reader&r, std::pair<std::string, std::unique_ptr<LspMessage>>& result)
 {
-        for (auto& handler : method2response)
+        bool resolved = false;
+        method2response.ForEach([&](const std::string& method, const GenericResponseJsonHandler& handler)
         {
+                if (resolved)
+                        return;
                 try
                 {
-                        auto msg =  handler.second(r);
-                        result.first = handler.first;
+                        auto msg =  handler(r);
+                        result.first = method;
                         result.second = std::move(msg);
-                        return true;
+                        resolved = true;
                 }
                 catch (...)
                 {
 
                 }
-        }
-        return false;
+        });
+        return resolved;
 }
 
 std::unique_ptr<LspMessage> MessageJsonHandler::parseNotificationMessage(const std::string& method, Reader& r)
 {
-        auto findIt = method2notification.find(method);
+        return parseNotificationMessage(lsp::MethodTable::Global().Find(method), r);
+}
 
-        if (findIt != method2notification.end())
-        {
-                return  findIt->second(r);
-        }
-        return nullptr;
+std::unique_ptr<LspMessage> MessageJsonHandler::parseResponseMessage(lsp::MethodId method, Reader& r)
+{
+        const auto handler = method2response.Find(method);
+        return handler ? (*handler)(r) : nullptr;
+}
+
+std::unique_ptr<LspMessage> MessageJsonHandler::parseRequstMessage(lsp::MethodId method, Reader& r)
+{
+        const auto handler = method2request.Find(method);
+        return handler ? (*handler)(r) : nullptr;
+}
+
+std::unique_ptr<LspMessage> MessageJsonHandler::parseNotificationMessage(lsp::MethodId method, Reader& r)
+{
+        const auto handler = method2notification.Find(method);
+        return handler ? (*handler)(r) : nullptr;
 }
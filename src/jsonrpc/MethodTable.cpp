@@ -0,0 +1,233 @@
+#include "LibLsp/JsonRpc/MethodTable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace lsp
+{
+namespace
+{
+        uint64_t HashName(string_view name)
+        {
+                // FNV-1a; method names share long prefixes such as
+                // "textDocument/", so every byte has to contribute.
+                uint64_t hash = 14695981039346656037ull;
+                for (char c : name)
+                {
+                        hash ^= static_cast<unsigned char>(c);
+                        hash *= 1099511628211ull;
+                }
+                return hash;
+        }
+
+        uint64_t Displace(uint64_t hash, uint32_t seed)
+        {
+                // splitmix64 finalizer over the hash and the bucket's seed.
+                uint64_t x = hash ^ (seed * 0x9E3779B97F4A7C15ull);
+                x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+                x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+                return x ^ (x >> 31);
+        }
+
+        size_t PowerOfTwoAtLeast(size_t n)
+        {
+                size_t size = 1;
+                while (size < n)
+                        size *= 2;
+                return size;
+        }
+
+        // Hash and displace: a name goes to the bucket picked by its hash, and
+        // each bucket has a seed chosen so that its names land in slots no
+        // other name took.
+        struct Snapshot
+        {
+                MethodId Lookup(string_view name) const
+                {
+                        const uint64_t hash = HashName(name);
+                        const uint32_t seed = seeds[(hash >> 32) & (seeds.size() - 1)];
+                        const MethodId id = slots[Displace(hash, seed) & (slots.size() - 1)];
+                        return id != kInvalidMethodId && names[id] == name ? id : kInvalidMethodId;
+                }
+
+                std::vector<uint32_t> seeds;
+                std::vector<MethodId> slots;
+                // Indexed by id; views into MethodTable::Data::names.
+                std::vector<string_view> names;
+        };
+
+        std::unique_ptr<Snapshot> Build(const std::deque<std::string>& all_names)
+        {
+                const size_t count = all_names.size();
+                std::vector<uint64_t> hashes(count);
+                for (size_t i = 0; i < count; ++i)
+                        hashes[i] = HashName(all_names[i]);
+
+                size_t slot_count = PowerOfTwoAtLeast(std::max<size_t>(2 * count, 1));
+                const size_t bucket_count = PowerOfTwoAtLeast(std::max<size_t>(count / 2, 1));
+                for (;;)
+                {
+                        std::unique_ptr<Snapshot> snapshot(new Snapshot());
+                        snapshot->seeds.assign(bucket_count, 0);
+                        snapshot->slots.assign(slot_count, kInvalidMethodId);
+
+                        std::vector<std::vector<MethodId>> buckets(bucket_count);
+                        for (size_t i = 0; i < count; ++i)
+                                buckets[(hashes[i] >> 32) & (bucket_count - 1)].push_back(static_cast<MethodId>(i + 1));
+                        std::vector<size_t> order(bucket_count);
+                        for (size_t i = 0; i < bucket_count; ++i)
+                                order[i] = i;
+                        // Crowded buckets first, while most slots are free.
+                        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                                {
+                                        return buckets[a].size() > buckets[b].size();
+                                });
+
+                        bool placed_all = true;
+                        std::vector<size_t> taken;
+                        for (size_t bucket : order)
+                        {
+                                const auto& ids = buckets[bucket];
+                                if (ids.empty())
+                                        break;
+                                bool placed = false;
+                                for (uint32_t seed = 0; seed < (1u << 16) && !placed; ++seed)
+                                {
+                                        taken.clear();
+                                        placed = true;
+                                        for (MethodId id : ids)
+                                        {
+                                                const size_t slot = Displace(hashes[id - 1], seed) & (slot_count - 1);
+                                                if (snapshot->slots[slot] != kInvalidMethodId
+                                                        || std::find(taken.begin(), taken.end(), slot) != taken.end())
+                                                {
+                                                        placed = false;
+                                                        break;
+                                                }
+                                                taken.push_back(slot);
+                                        }
+                                        if (placed)
+                                        {
+                                                snapshot->seeds[bucket] = seed;
+                                                for (size_t i = 0; i < ids.size(); ++i)
+                                                        snapshot->slots[taken[i]] = ids[i];
+                                        }
+                                }
+                                if (!placed)
+                                {
+                                        placed_all = false;
+                                        break;
+                                }
+                        }
+                        if (!placed_all)
+                        {
+                                slot_count *= 2;
+                                continue;
+                        }
+
+                        snapshot->names.reserve(count + 1);
+                        snapshot->names.push_back(string_view());
+                        for (const auto& name : all_names)
+                                snapshot->names.push_back(name);
+                        return snapshot;
+                }
+        }
+}
+
+struct MethodTable::Data
+{
+        mutable std::mutex mutex;
+        // Name of id i + 1; a deque so that the views in snapshots stay valid.
+        std::deque<std::string> names;
+        std::unordered_map<std::string, MethodId> ids;
+
+        std::atomic<const Snapshot*> snapshot{ nullptr };
+        // Set when |names| has grown past |snapshot|.
+        std::atomic<bool> stale{ false };
+        // Replaced snapshots may still be read by concurrent lookups, so they
+        // are kept. There is one per burst of interning followed by a lookup,
+        // which in practice means a handful at start-up.
+        std::vector<std::unique_ptr<Snapshot>> snapshots;
+
+        const Snapshot* Refresh()
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stale.load(std::memory_order_relaxed))
+                {
+                        snapshots.push_back(Build(names));
+                        snapshot.store(snapshots.back().get(), std::memory_order_release);
+                        stale.store(false, std::memory_order_release);
+                }
+                return snapshot.load(std::memory_order_relaxed);
+        }
+};
+
+MethodTable& MethodTable::Global()
+{
+        static MethodTable* table = new MethodTable();
+        return *table;
+}
+
+MethodTable::MethodTable() : d_ptr(new Data())
+{
+}
+
+MethodTable::~MethodTable()
+{
+        delete d_ptr;
+}
+
+MethodId MethodTable::Intern(string_view name)
+{
+        // Only the current snapshot: rebuilding it here would make every new
+        // name pay for a rebuild. The next Find() does it once for all of them.
+        if (const Snapshot* snapshot = d_ptr->snapshot.load(std::memory_order_acquire))
+        {
+                const MethodId existing = snapshot->Lookup(name);
+                if (existing != kInvalidMethodId)
+                        return existing;
+        }
+
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        std::string key(name.data(), name.size());
+        const auto findIt = d_ptr->ids.find(key);
+        if (findIt != d_ptr->ids.end())
+                return findIt->second;
+        d_ptr->names.push_back(key);
+        const MethodId id = static_cast<MethodId>(d_ptr->names.size());
+        d_ptr->ids.emplace(std::move(key), id);
+        d_ptr->stale.store(true, std::memory_order_release);
+        return id;
+}
+
+MethodId MethodTable::Find(string_view name) const
+{
+        const Snapshot* snapshot = d_ptr->snapshot.load(std::memory_order_acquire);
+        if (snapshot)
+        {
+                const MethodId id = snapshot->Lookup(name);
+                if (id != kInvalidMethodId)
+                        return id;
+        }
+        if (!d_ptr->stale.load(std::memory_order_acquire))
+                return kInvalidMethodId;
+        return d_ptr->Refresh()->Lookup(name);
+}
+
+const std::string& MethodTable::Name(MethodId id) const
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        return d_ptr->names.at(id - 1);
+}
+
+size_t MethodTable::size() const
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        return d_ptr->names.size();
+}
+
+}
@@ -0,0 +1,79 @@
+#include "LibLsp/JsonRpc/Metrics.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace lsp
+{
+struct Metrics::Data
+{
+        struct Gauge
+        {
+                std::string name;
+                std::function<int64_t()> read;
+        };
+
+        mutable std::mutex mutex;
+        std::map<std::string, std::unique_ptr<Counter>> counters;
+        std::unordered_map<GaugeId, Gauge> gauges;
+        GaugeId next_gauge = 1;
+};
+
+Metrics& Metrics::Global()
+{
+        // Leaked so counters stay usable during static destruction.
+        static Metrics* metrics = new Metrics();
+        return *metrics;
+}
+
+Metrics::Metrics() : d_ptr(new Data())
+{
+}
+
+Metrics::~Metrics()
+{
+        delete d_ptr;
+}
+
+Metrics::Counter& Metrics::GetCounter(const std::string& name)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        auto& counter = d_ptr->counters[name];
+        if (!counter)
+                counter.reset(new Counter());
+        return *counter;
+}
+
+Metrics::GaugeId Metrics::AddGauge(const std::string& name, std::function<int64_t()> read)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        const GaugeId id = d_ptr->next_gauge++;
+        d_ptr->gauges.emplace(id, Data::Gauge{ name, std::move(read) });
+        return id;
+}
+
+void Metrics::RemoveGauge(GaugeId id)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        d_ptr->gauges.erase(id);
+}
+
+std::vector<std::pair<std::string, int64_t>> Metrics::Snapshot() const
+{
+        std::vector<std::pair<std::string, int64_t>> values;
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                values.reserve(d_ptr->counters.size() + d_ptr->gauges.size());
+                for (auto& it : d_ptr->counters)
+                        values.emplace_back(it.first, it.second->Get());
+                for (auto& it : d_ptr->gauges)
+                        values.emplace_back(it.second.name, it.second.read());
+        }
+        std::sort(values.begin(), values.end());
+        return values;
+}
+
+}
@@ -9,11 +9,17 @@
 #include "LibLsp/JsonRpc/lsResponseMessage.h"
 #include "LibLsp/JsonRpc/Condition.h"
 #include "LibLsp/JsonRpc/Context.h"
+#include "LibLsp/JsonRpc/AdmissionController.h"
+#include "LibLsp/JsonRpc/FrameWriter.h"
 #include "rapidjson/error/en.h"
 #include "LibLsp/JsonRpc/json.h"
+#include "LibLsp/JsonRpc/MessageArena.h"
+#include "LibLsp/JsonRpc/Metrics.h"
 #include "LibLsp/JsonRpc/ScopeExit.h"
 #include "LibLsp/JsonRpc/stream.h"
 #include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <optional>
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
@@ -131,16 +137,22 @@ public:
         PendingRequestInfo(const std::string& md);
         PendingRequestInfo() {}
         std::string method;
+        lsp::MethodId method_id = lsp::kInvalidMethodId;
         RequestCallBack futureInfo;
+        // Reads the response; set by the typed send(), so responses need no
+        // entry in the MessageJsonHandler.
+        GenericResponseJsonHandler parser;
 };
 
 PendingRequestInfo::PendingRequestInfo(const std::string& _md,
         const   RequestCallBack& callback) : method(_md),
+        method_id(MethodTable::Global().Intern(_md)),
         futureInfo(callback)
 {
 }
 
-PendingRequestInfo::PendingRequestInfo(const std::string& md) : method(md)
+PendingRequestInfo::PendingRequestInfo(const std::string& md) : method(md),
+        method_id(MethodTable::Global().Intern(md))
 {
 }
 struct RemoteEndPoint::Data
@@ -203,13 +215,29 @@ struct RemoteEndPoint::Data
         std::map <lsRequestId, std::shared_ptr<PendingRequestInfo>>  _client_request_futures;
         StreamMessageProducer* message_producer;
         std::atomic<bool> quit{};
+        std::atomic<bool> parse_insitu{ true };
+        // Registration only; dispatch reads the tables without it once frozen.
+        std::mutex registration_mutex;
+        std::atomic<bool> frozen{ false };
         lsp::Log& log;
         std::shared_ptr<lsp::istream>  input;
         std::shared_ptr<lsp::ostream>  output;
+        // The only thread that writes to |output|.
+        lsp::FrameWriter writer;
+        // Read by the reader thread, drained by the workers.
+        lsp::IntakeQueue intake;
+        std::atomic<lsp::IntakeOverflow> intake_overflow{ lsp::IntakeOverflow::Block };
+        // Non-zero for low priority methods. Written under
+        // |registration_mutex| until frozen.
+        lsp::MethodSlots<unsigned char> low_priority;
+        lsp::Metrics::Counter& intake_shed = lsp::Metrics::Global().GetCounter("intake.shed");
+        lsp::AdmissionController admission{ max_workers };
+        lsp::Metrics::Counter& admission_shed = lsp::Metrics::Global().GetCounter("admission.shed");
 
     std::mutex m_requestInfo;
 
-        bool pendingRequest(RequestInMessage& info, GenericResponseHandler&& handler)
+        bool pendingRequest(RequestInMessage& info, GenericResponseHandler&& handler,
+                GenericResponseJsonHandler&& parser)
         {
         bool ret = true;
         std::lock_guard<std::mutex> lock(m_requestInfo);
@@ -222,7 +250,9 @@ struct RemoteEndPoint::Data
                 ret =  false;
             }
         }
-        _client_request_futures[info.id] = std::make_shared<PendingRequestInfo>(info.method, handler);
+        auto pending = std::make_shared<PendingRequestInfo>(info.method, handler);
+        pending->parser = std::move(parser);
+        _client_request_futures[info.id] = std::move(pending);
         return ret;
         }
         const std::shared_ptr<const PendingRequestInfo> getRequestInfo(const lsRequestId& _id)
@@ -254,6 +284,8 @@ struct RemoteEndPoint::Data
         if(tp){
             tp->stop();
         }
+                intake.Close();
+                writer.Stop();
                 quit.store(true, std::memory_order_relaxed);
         }
 
@@ -265,13 +297,47 @@ struct RemoteEndPoint::Data
 
 namespace
 {
-void WriterMsg(std::shared_ptr<lsp::ostream>&  output, LspMessage& msg)
+// Room left in front of the body for "Content-Length: <20 digits>\r\n\r\n".
+constexpr size_t kHeaderReserve = 48;
+// A buffer that grew past this for one large message is not kept around.
+constexpr size_t kMaxRetainedBuffer = 1024 * 1024;
+
+// The body is serialized into a buffer owned by the thread, behind space
+// reserved for the header; the header is filled in once the length is known
+// and the frame is copied out once, at its exact size, for the writer thread.
+std::string SerializeFrame(LspMessage& msg)
 {
-        const auto& s = msg.ToJson();
-        const auto value =
-                std::string("Content-Length: ") + std::to_string(s.size()) + "\r\n\r\n" + s;
-        output->write(value);
-        output->flush();
+        thread_local rapidjson::StringBuffer buffer;
+        buffer.Clear();
+        buffer.Push(kHeaderReserve);
+        {
+                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+                JsonWriter json_writer{ &writer };
+                msg.ReflectWriter(json_writer);
+        }
+        const size_t body_size = buffer.GetSize() - kHeaderReserve;
+        char* base = const_cast<char*>(buffer.GetString());
+
+        char header[kHeaderReserve];
+        const int header_size = snprintf(header, sizeof header, "Content-Length: %zu\r\n\r\n", body_size);
+        char* header_begin = base + kHeaderReserve - header_size;
+        memcpy(header_begin, header, header_size);
+        std::string frame(header_begin, header_size + body_size);
+
+        if (buffer.GetSize() > kMaxRetainedBuffer)
+        {
+                buffer.Clear();
+                buffer.ShrinkToFit();
+        }
+        return frame;
+}
+
+// The one hash of the method name per message; parsers and handlers are
+// then found by indexing with the id.
+MethodId MethodOf(const MessageDocument& document)
+{
+        const auto& method = document["method"];
+        return MethodTable::Global().Find(string_view(method.GetString(), method.GetStringLength()));
 }
 
 bool isResponseMessage(JsonReader& visitor)
@@ -346,6 +412,11 @@ RemoteEndPoint::RemoteEndPoint(
         {
                 return Notify_Cancellation::notify::ReflectReader(visitor);
         };
+        // Requests the server may cancel; each is refreshed by the client on
+        // its next edit anyway.
+        for (const char* method : { "textDocument/codeLens", "textDocument/documentLink",
+                "textDocument/foldingRange", "textDocument/documentColor" })
+                d_ptr->low_priority[method] = 1;
 
         d_ptr->quit.store(false, std::memory_order_relaxed);
 }
@@ -356,10 +427,16 @@ RemoteEndPoint::~RemoteEndPoint()
         d_ptr->quit.store(true, std::memory_order_relaxed);
 }
 
-bool RemoteEndPoint::dispatch(const std::string& content)
+bool RemoteEndPoint::dispatch(std::string& content)
 {
-                rapidjson::Document document;
-                document.Parse(content.c_str(), content.length());
+                // The DOM only lives until the message objects are built.
+                MessageArena arena;
+                auto& document = arena.document();
+                const bool insitu = d_ptr->parse_insitu.load(std::memory_order_relaxed);
+                if (insitu)
+                        document.ParseInsitu(&content[0]);
+                else
+                        document.Parse(content.c_str(), content.length());
                 if (document.HasParseError())
                 {
                         std::string info ="lsp msg format error:";
@@ -374,12 +451,17 @@ bool RemoteEndPoint::dispatch(const std::string& content)
                 }
 
                 JsonReader visitor{ &document };
+                // An in-situ parse has decoded strings over |content|.
+                const auto message_text = [&]() -> std::string
+                {
+                        return insitu ? visitor.ToString() : content;
+                };
                 if (!visitor.HasMember("jsonrpc") ||
-                        std::string(visitor["jsonrpc"]->GetString()) != "2.0")
+                        !document["jsonrpc"].IsString() || std::string(document["jsonrpc"].GetString()) != "2.0")
                 {
                         std::string reason;
                         reason = "Reason:Bad or missing jsonrpc version\n";
-                        reason += "content:\n" + content;
+                        reason += "content:\n" + message_text();
                         d_ptr->log.log(Log::Level::SEVERE, reason);
                         return  false;
 
@@ -389,13 +471,15 @@ bool RemoteEndPoint::dispatch(const std::string& content)
                         if (isRequestMessage(visitor))
                         {
                                 _kind = LspMessage::REQUEST_MESSAGE;
-                                auto msg = jsonHandler->parseRequstMessage(visitor["method"]->GetString(), visitor);
+                                const MethodId method = MethodOf(document);
+                                auto msg = jsonHandler->parseRequstMessage(method, visitor);
                                 if (msg) {
+                                        msg->method_id = method;
                                         mainLoop(std::move(msg));
                                 }
                                 else {
                                         std::string info = "Unknown support request message when consumer message:\n";
-                                        info += content;
+                                        info += message_text();
                                         d_ptr->log.log(Log::Level::WARNING, info);
                                         return false;
                                 }
@@ -410,20 +494,23 @@ bool RemoteEndPoint::dispatch(const std::string& content)
                                 if (!msgInfo)
                                 {
                     std::string info = "Unknown response message :\n";
-                    info += content;
+                    info += message_text();
                     d_ptr->log.log(Log::Level::INFO, info);
                                 }
                                 else
                                 {
 
-                                        auto msg = jsonHandler->parseResponseMessage(msgInfo->method, visitor);
+                                        auto msg = msgInfo->parser
+                                                ? msgInfo->parser(visitor)
+                                                : jsonHandler->parseResponseMessage(msgInfo->method_id, visitor);
                                         if (msg) {
+                                                msg->method_id = msgInfo->method_id;
                                                 mainLoop(std::move(msg));
                                         }
                                         else
                                         {
                                                 std::string info = "Unknown response message :\n";
-                                                info += content;
+                                                info += message_text();
                                                 d_ptr->log.log(Log::Level::SEVERE, info);
                                                 return  false;
                                         }
@@ -432,20 +519,22 @@ bool RemoteEndPoint::dispatch(const std::string& content)
                         }
                         else if (isNotificationMessage(visitor))
                         {
-                                auto msg = jsonHandler->parseNotificationMessage(visitor["method"]->GetString(), visitor);
+                                const MethodId method = MethodOf(document);
+                                auto msg = jsonHandler->parseNotificationMessage(method, visitor);
                                 if (!msg)
                                 {
                                         std::string info = "Unknown notification message :\n";
-                                        info += content;
+                                        info += message_text();
                                         d_ptr->log.log(Log::Level::SEVERE, info);
                                         return  false;
                                 }
+                                msg->method_id = method;
                                 mainLoop(std::move(msg));
                         }
                         else
                         {
                                 std::string info = "Unknown lsp message when consumer message:\n";
-                                info += content;
+                                info += message_text();
                                 d_ptr->log.log(Log::Level::WARNING, info);
                                 return false;
                         }
@@ -469,7 +558,7 @@ bool RemoteEndPoint::dispatch(const std::string& content)
                         info += " message:\n";
                         info += e.what();
                         std::string reason = "Reason:" + info + "\n";
-                        reason += "content:\n" + content;
+                        reason += "content:\n" + message_text();
                         d_ptr->log.log(Log::Level::SEVERE, reason);
                         return false;
                 }
@@ -478,23 +567,28 @@ bool RemoteEndPoint::dispatch(const std::string& content)
 
 
 
-bool RemoteEndPoint::internalSendRequest(RequestInMessage& info, GenericResponseHandler handler)
+bool RemoteEndPoint::internalSendRequest(RequestInMessage& info, GenericResponseHandler handler,
+        GenericResponseJsonHandler parser)
 {
-        std::lock_guard<std::mutex> lock(m_sendMutex);
         if (!d_ptr->output || d_ptr->output->bad())
         {
                 std::string desc = "Output isn't good any more:\n";
                 d_ptr->log.log(Log::Level::WARNING, desc);
                 return false;
         }
-        if(!d_ptr->pendingRequest(info, std::move(handler)))
+        if(!d_ptr->pendingRequest(info, std::move(handler), std::move(parser)))
     {
         std::string desc = "Duplicate id  which of request:";
         desc += info.ToJson();
         desc += "\n";
         d_ptr->log.log(Log::Level::WARNING, desc);
     }
-        WriterMsg(d_ptr->output, info);
+        if (!d_ptr->writer.Push(SerializeFrame(info)))
+        {
+                d_ptr->removeRequestInfo(info.id);
+                d_ptr->log.log(Log::Level::WARNING, "Output isn't good any more:\n");
+                return false;
+        }
     return true;
 }
 
@@ -537,7 +631,11 @@ void RemoteEndPoint::mainLoop(std::unique_ptr<LspMessage>msg)
                 auto req = static_cast<RequestInMessage*>(msg.get());
                 // Calls can be canceled by the client. Add cancellation context.
                 WithContext WithCancel(d_ptr->cancelableRequestContext(req->id));
+                const MethodId method = msg->method_id;
+                const int64_t expected = d_ptr->admission.Started(method);
+                const auto started = std::chrono::steady_clock::now();
                 local_endpoint->onRequest(std::move(msg));
+                d_ptr->admission.Finished(method, expected, std::chrono::steady_clock::now() - started);
         }
 
         else if (_kind == LspMessage::RESPONCE_MESSAGE)
@@ -574,7 +672,11 @@ void RemoteEndPoint::mainLoop(std::unique_ptr<LspMessage>msg)
                 }
                 else
                 {
+                        const MethodId method = msg->method_id;
+                        const int64_t expected = d_ptr->admission.Started(method);
+                        const auto started = std::chrono::steady_clock::now();
                         local_endpoint->notify(std::move(msg));
+                        d_ptr->admission.Finished(method, expected, std::chrono::steady_clock::now() - started);
                 }
 
         }
@@ -602,25 +704,83 @@ void RemoteEndPoint::handle(MessageIssue&& issue)
 void RemoteEndPoint::startProcessingMessages(std::shared_ptr<lsp::istream> r,
         std::shared_ptr<lsp::ostream> w)
 {
+        // Workers index the handler tables without a lock from now on.
+        freeze();
         d_ptr->quit.store(false, std::memory_order_relaxed);
         d_ptr->input = r;
         d_ptr->output = w;
+        d_ptr->writer.Start(w);
+        d_ptr->intake.Open();
+        d_ptr->admission.Reserve(MethodTable::Global().size());
         d_ptr->message_producer->bind(r);
     d_ptr->tp = std::make_shared<boost::asio::thread_pool>(d_ptr->max_workers);
         message_producer_thread_ = std::make_shared<std::thread>([&]()
    {
                 d_ptr->message_producer->listen([&](std::string&& content){
-                        const auto temp = std::make_shared<std::string>(std::move(content));
-            boost::asio::post(*d_ptr->tp,
-                        [this, temp]{
+                        enqueue(std::move(content));
+                });
+        });
+}
+
+void RemoteEndPoint::enqueue(std::string&& content)
+{
+        if (d_ptr->admission.OverBudget(d_ptr->intake.depth()) && shed(content))
+        {
+                d_ptr->admission_shed.Add();
+                return;
+        }
+        if (!d_ptr->intake.TryPush(content))
+        {
+                if (d_ptr->intake_overflow.load(std::memory_order_relaxed) == IntakeOverflow::ShedLowPriority
+                        && shed(content))
+                {
+                        d_ptr->intake_shed.Add();
+                        return;
+                }
+                // Stops reading until a worker makes room.
+                if (!d_ptr->intake.Push(std::move(content)))
+                        return;
+        }
+        // Each task takes whichever message is first in line.
+        boost::asio::post(*d_ptr->tp, [this]
+                {
 #ifdef LSPCPP_USEGC
                         GCThreadContext gcContext;
 #endif
-
-                                                dispatch(*temp);
-                                });
+                        std::string message;
+                        if (d_ptr->intake.TryPop(message))
+                                dispatch(message);
                 });
-        });
+}
+
+bool RemoteEndPoint::shed(const std::string& content)
+{
+        // Only messages arriving under load are parsed here, to find their
+        // method; the workers parse them again.
+        MessageArena arena;
+        auto& document = arena.document();
+        document.Parse(content.c_str(), content.length());
+        if (document.HasParseError() || !document.IsObject())
+                return false;
+        JsonReader visitor{ &document };
+        const bool request = isRequestMessage(visitor);
+        if (!request && !isNotificationMessage(visitor))
+                return false;
+        const MethodId method = MethodOf(document);
+        if (!d_ptr->low_priority.Find(method))
+                return false;
+
+        if (request)
+        {
+                Rsp_Error rsp;
+                ReflectMember(visitor, "id", rsp.id);
+                rsp.error.code = lsErrorCodes::ServerCancelled;
+                rsp.error.message = "The server is too busy to handle ";
+                rsp.error.message += document["method"].GetString();
+                rsp.error.message += " now.";
+                sendMsg(rsp);
+        }
+        return true;
 }
 
 void RemoteEndPoint::stop()
@@ -636,16 +796,85 @@ void RemoteEndPoint::stop()
 
 void RemoteEndPoint::sendMsg( LspMessage& msg)
 {
-
-        std::lock_guard<std::mutex> lock(m_sendMutex);
-        if (!d_ptr->output || d_ptr->output->bad())
+        if (!d_ptr->writer.Push(SerializeFrame(msg)))
         {
                 std::string info = "Output isn't good any more:\n";
                 d_ptr->log.log(Log::Level::INFO, info);
-                return;
         }
-        WriterMsg(d_ptr->output, msg);
+}
+
+void RemoteEndPoint::setSendQueueLimit(size_t bytes)
+{
+        d_ptr->writer.SetMaxQueuedBytes(bytes);
+}
+
+void RemoteEndPoint::setIntakeLimits(const IntakeQueue::Limits& limits, IntakeOverflow overflow)
+{
+        d_ptr->intake.SetLimits(limits);
+        d_ptr->intake_overflow.store(overflow, std::memory_order_relaxed);
+}
+
+void RemoteEndPoint::setLatencyBudget(std::chrono::milliseconds budget)
+{
+        d_ptr->admission.SetBudget(budget);
+}
+
+bool RemoteEndPoint::setLowPriority(const std::string& method, bool low_priority)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->registration_mutex);
+        if (d_ptr->frozen.load(std::memory_order_relaxed))
+        {
+                d_ptr->log.log(Log::Level::SEVERE, "Priority of " + method + " changed after freeze(); ignored.\n");
+                return false;
+        }
+        d_ptr->low_priority[method] = low_priority ? 1 : 0;
+        return true;
+}
+
+void RemoteEndPoint::freeze()
+{
+        std::lock_guard<std::mutex> lock(d_ptr->registration_mutex);
+        d_ptr->frozen.store(true, std::memory_order_release);
+}
+
+bool RemoteEndPoint::isFrozen() const
+{
+        return d_ptr->frozen.load(std::memory_order_acquire);
+}
+
+bool RemoteEndPoint::registerRequest(const char* method, GenericRequestJsonHandler parser,
+        GenericRequestHandler handler)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->registration_mutex);
+        if (d_ptr->frozen.load(std::memory_order_relaxed))
+        {
+                d_ptr->log.log(Log::Level::SEVERE, std::string("Handler for ") + method + " registered after freeze(); ignored.\n");
+                return false;
+        }
+        if (!jsonHandler->GetRequestJsonHandler(method))
+                jsonHandler->SetRequestJsonHandler(method, std::move(parser));
+        local_endpoint->registerRequestHandler(method, std::move(handler));
+        return true;
+}
+
+bool RemoteEndPoint::registerNotification(const char* method, GenericNotificationJsonHandler parser,
+        GenericNotificationHandler handler)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->registration_mutex);
+        if (d_ptr->frozen.load(std::memory_order_relaxed))
+        {
+                d_ptr->log.log(Log::Level::SEVERE, std::string("Handler for ") + method + " registered after freeze(); ignored.\n");
+                return false;
+        }
+        if (!jsonHandler->GetNotificationJsonHandler(method))
+                jsonHandler->SetNotificationJsonHandler(method, std::move(parser));
+        local_endpoint->registerNotifyHandler(method, std::move(handler));
+        return true;
+}
 
+void RemoteEndPoint::setParseInsitu(bool insitu)
+{
+        d_ptr->parse_insitu.store(insitu, std::memory_order_relaxed);
 }
 
 bool RemoteEndPoint::isWorking() const {
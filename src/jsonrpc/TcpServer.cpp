@@ -3,6 +3,10 @@
 
 #include "LibLsp/JsonRpc/TcpServer.h"
 #include <signal.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <utility>
 #include <boost/bind/bind.hpp>
 
@@ -64,6 +68,8 @@ namespace lsp {
 
                 tcp_stream_wrapper& write(std::streamsize _s) override;
 
+                tcp_stream_wrapper& write(const const_buffer* buffers, size_t count) override;
+
                 tcp_stream_wrapper& flush() override
                 {
                     return *this;
@@ -92,24 +98,92 @@ namespace lsp {
             /// Strand to ensure the connection's handlers are not called concurrently.
             boost::asio::io_context::strand strand_;
             std::shared_ptr<tcp_stream_wrapper>  proxy_;
+            /// Owned by |strand_|.
+            std::vector<std::shared_ptr<std::vector<char>>> pending_writes_;
+            std::vector<std::shared_ptr<std::vector<char>>> writing_;
+            /// Bytes handed to do_write() and not yet taken by the socket. A
+            /// writer blocks while there are more than kMaxBytesInFlight, so
+            /// a client that stops reading holds up the FrameWriter, whose
+            /// queue is bounded, instead of growing this one.
+            static constexpr size_t kMaxBytesInFlight = 1024 * 1024;
+            std::mutex flow_mutex_;
+            std::condition_variable flow_cv_;
+            size_t bytes_in_flight_ = 0;
+            bool write_failed_ = false;
             explicit tcp_connect_session(boost::asio::io_context& io_context, boost::asio::ip::tcp::socket&& _socket)
                     : socket_(std::move(_socket)), strand_(io_context), proxy_(new tcp_stream_wrapper(*this))
             {
                 do_read();
             }
-            void do_write(const char* data, size_t size)
+            // Sends |payload| after everything queued before it. Payloads
+            // queued while a write is in flight go out together in one gather
+            // write.
+            void do_write(std::shared_ptr<std::vector<char>> payload)
             {
-                socket_.async_write_some(boost::asio::buffer(data, size),
+                {
+                    std::lock_guard<std::mutex> lock(flow_mutex_);
+                    bytes_in_flight_ += payload->size();
+                }
+                boost::asio::post(strand_, [this, payload]
+                {
+                    pending_writes_.push_back(payload);
+                    if (writing_.empty())
+                        start_write();
+                });
+            }
+            void start_write()
+            {
+                writing_.swap(pending_writes_);
+                std::vector<boost::asio::const_buffer> buffers;
+                buffers.reserve(writing_.size());
+                for (auto& payload : writing_)
+                    buffers.emplace_back(boost::asio::buffer(*payload));
+                boost::asio::async_write(socket_, buffers,
                                          boost::asio::bind_executor(strand_,[this](boost::system::error_code ec, std::size_t n)
                                          {
-                                             if (!ec)
+                                             writing_.clear();
+                                             {
+                                                 std::lock_guard<std::mutex> lock(flow_mutex_);
+                                                 bytes_in_flight_ -= std::min(bytes_in_flight_, n);
+                                                 if (ec)
+                                                 {
+                                                     write_failed_ = true;
+                                                     bytes_in_flight_ = 0;
+                                                 }
+                                             }
+                                             flow_cv_.notify_all();
+                                             if (ec)
                                              {
+                                                 proxy_->error_message = ec.message();
+                                                 pending_writes_.clear();
                                                  return;
                                              }
-                                             proxy_->error_message = ec.message();
-
+                                             if (!pending_writes_.empty())
+                                                 start_write();
                                          }));
             }
+            // Blocks until no more than kMaxBytesInFlight wait for the socket.
+            // Returns false once writing has failed or the socket is closed.
+            bool wait_for_room()
+            {
+                std::unique_lock<std::mutex> lock(flow_mutex_);
+                for (;;)
+                {
+                    if (write_failed_)
+                        return false;
+                    if (bytes_in_flight_ <= kMaxBytesInFlight)
+                        return true;
+                    // Nothing completes a write once the socket is closed.
+                    if (!socket_.is_open())
+                        return false;
+                    flow_cv_.wait_for(lock, std::chrono::milliseconds(100));
+                }
+            }
+            bool write_failed()
+            {
+                std::lock_guard<std::mutex> lock(flow_mutex_);
+                return write_failed_;
+            }
             void do_read()
             {
                 socket_.async_read_some(boost::asio::buffer(buffer_),
@@ -135,28 +209,33 @@ namespace lsp {
 
         bool tcp_stream_wrapper::bad()
     {
-        return !session.socket_.is_open();
+        return !session.socket_.is_open() || session.write_failed();
     }
 
         tcp_stream_wrapper& tcp_stream_wrapper::write(const std::string& c)
         {
-            size_t off = 0;
-            for(;off < c.size();){
-                if(off + 1024 < c.size()){
-                    session.do_write(c.data()+off,1024);
-                    off += 1024;
-                }else{
-                    session.do_write(c.data()+off,c.size() - off);
-                    break;
-                }
-            }
-            return *this;
+            const const_buffer buffer{ c.data(), c.size() };
+            return write(&buffer, 1);
         }
 
     tcp_stream_wrapper& tcp_stream_wrapper::write(std::streamsize _s)
     {
-        auto s = std::to_string(_s);
-        session.do_write(s.data(),s.size());
+        return write(std::to_string(_s));
+    }
+
+    tcp_stream_wrapper& tcp_stream_wrapper::write(const const_buffer* buffers, size_t count)
+    {
+        // The caller's buffers do not outlive this call, so they are joined
+        // into one payload that the asynchronous write owns.
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i)
+            size += buffers[i].size;
+        auto payload = std::make_shared<std::vector<char>>();
+        payload->reserve(size);
+        for (size_t i = 0; i < count; ++i)
+            payload->insert(payload->end(), buffers[i].data, buffers[i].data + buffers[i].size);
+        session.do_write(std::move(payload));
+        session.wait_for_room();
         return *this;
     }
 
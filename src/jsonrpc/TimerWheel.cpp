@@ -0,0 +1,306 @@
+#include "LibLsp/JsonRpc/TimerWheel.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+namespace lsp
+{
+namespace
+{
+        constexpr unsigned kLevels = 4;
+        constexpr unsigned kSlotBits = 6;
+        constexpr unsigned kSlots = 1u << kSlotBits;
+        constexpr uint64_t kSlotMask = kSlots - 1;
+        // Farthest expiry the top level can hold; later ones are parked there
+        // and re-filed when their slot cascades.
+        constexpr uint64_t kMaxDelta = (uint64_t(1) << (kSlotBits * kLevels)) - 1;
+
+        unsigned CountTrailingZeros(uint64_t value)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+                return static_cast<unsigned>(__builtin_ctzll(value));
+#else
+                unsigned count = 0;
+                while (!(value & 1))
+                {
+                        value >>= 1;
+                        ++count;
+                }
+                return count;
+#endif
+        }
+
+        uint64_t RotateRight(uint64_t value, unsigned shift)
+        {
+                shift &= 63;
+                return shift ? (value >> shift) | (value << (64 - shift)) : value;
+        }
+}
+
+struct TimerWheel::Data
+{
+        using Clock = std::chrono::steady_clock;
+
+        struct Timer
+        {
+                TimerId id;
+                uint64_t expiry;
+                uint64_t period;
+                Callback callback;
+                unsigned level;
+                unsigned slot;
+        };
+        using Slot = std::list<Timer>;
+
+        explicit Data(Executor&& _executor) : executor(std::move(_executor)), start(Clock::now())
+        {
+                occupied.fill(0);
+                worker = std::thread([this] { Run(); });
+        }
+
+        ~Data()
+        {
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        quit = true;
+                }
+                cv.notify_all();
+                if (worker.joinable())
+                        worker.join();
+        }
+
+        uint64_t TickOf(Clock::time_point time) const
+        {
+                return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time - start).count());
+        }
+
+        // Files |timer| relative to |current| without touching |index|.
+        void Place(Slot& from, Slot::iterator timer)
+        {
+                uint64_t delta = timer->expiry > current ? timer->expiry - current : 0;
+                uint64_t expiry = timer->expiry;
+                if (delta > kMaxDelta)
+                {
+                        delta = kMaxDelta;
+                        expiry = current + kMaxDelta;
+                }
+                unsigned level = 0;
+                while (level + 1 < kLevels && delta >= (uint64_t(1) << (kSlotBits * (level + 1))))
+                        ++level;
+                const unsigned slot = static_cast<unsigned>((expiry >> (kSlotBits * level)) & kSlotMask);
+                timer->level = level;
+                timer->slot = slot;
+                auto& to = slots[level][slot];
+                to.splice(to.end(), from, timer);
+                occupied[level] |= uint64_t(1) << slot;
+        }
+
+        void Unlink(Slot::iterator timer)
+        {
+                const unsigned level = timer->level;
+                const unsigned index = timer->slot;
+                auto& slot = slots[level][index];
+                slot.erase(timer);
+                if (slot.empty())
+                        occupied[level] &= ~(uint64_t(1) << index);
+        }
+
+        TimerId Add(std::chrono::milliseconds delay, uint64_t period, Callback&& callback)
+        {
+                TimerId id;
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        id = next_id++;
+                        const uint64_t now = TickOf(Clock::now());
+                        // An idle wheel has nothing to catch up on.
+                        if (index.empty() && now > current)
+                                current = now;
+                        const uint64_t ticks = delay.count() > 0 ? static_cast<uint64_t>(delay.count()) : 1;
+                        Slot staging;
+                        staging.push_back(Timer{ id, now + ticks, period, std::move(callback), 0, 0 });
+                        auto timer = staging.begin();
+                        Place(staging, timer);
+                        index.emplace(id, timer);
+                }
+                cv.notify_one();
+                return id;
+        }
+
+        // Re-files every timer of a higher level slot that is due to be split.
+        void Cascade(unsigned level, unsigned slot)
+        {
+                auto& from = slots[level][slot];
+                occupied[level] &= ~(uint64_t(1) << slot);
+                while (!from.empty())
+                        Place(from, from.begin());
+        }
+
+        // Moves |current| forward by one tick and collects what expires there.
+        void Step(std::vector<Callback>& expired)
+        {
+                ++current;
+                for (unsigned level = kLevels - 1; level > 0; --level)
+                {
+                        if (current & ((uint64_t(1) << (kSlotBits * level)) - 1))
+                                continue;
+                        Cascade(level, static_cast<unsigned>((current >> (kSlotBits * level)) & kSlotMask));
+                }
+
+                const unsigned slot = static_cast<unsigned>(current & kSlotMask);
+                auto& due = slots[0][slot];
+                occupied[0] &= ~(uint64_t(1) << slot);
+                Slot rearm;
+                while (!due.empty())
+                {
+                        auto timer = due.begin();
+                        if (timer->period)
+                        {
+                                // Re-armed before it runs, so the callback may cancel itself.
+                                expired.push_back(timer->callback);
+                                timer->expiry = current + timer->period;
+                                rearm.splice(rearm.end(), due, timer);
+                        }
+                        else
+                        {
+                                expired.push_back(std::move(timer->callback));
+                                index.erase(timer->id);
+                                due.erase(timer);
+                        }
+                }
+                while (!rearm.empty())
+                        Place(rearm, rearm.begin());
+        }
+
+        // First tick after |current| at which a slot fires or cascades.
+        uint64_t NextEvent() const
+        {
+                uint64_t next = UINT64_MAX;
+                for (unsigned level = 0; level < kLevels; ++level)
+                {
+                        if (!occupied[level])
+                                continue;
+                        const unsigned shift = kSlotBits * level;
+                        const uint64_t base = current >> shift;
+                        const uint64_t distance = CountTrailingZeros(
+                                RotateRight(occupied[level], static_cast<unsigned>((base + 1) & kSlotMask))) + 1;
+                        const uint64_t tick = (base + distance) << shift;
+                        if (tick < next)
+                                next = tick;
+                }
+                return next;
+        }
+
+        void Advance(uint64_t target, std::vector<Callback>& expired)
+        {
+                while (current < target)
+                {
+                        const uint64_t next = NextEvent();
+                        if (next > target)
+                        {
+                                current = target;
+                                return;
+                        }
+                        current = next - 1;
+                        Step(expired);
+                }
+        }
+
+        void Run()
+        {
+                std::vector<Callback> expired;
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!quit)
+                {
+                        Advance(TickOf(Clock::now()), expired);
+                        if (!expired.empty())
+                        {
+                                lock.unlock();
+                                for (auto& callback : expired)
+                                {
+                                        if (executor)
+                                                executor(std::move(callback));
+                                        else
+                                                callback();
+                                }
+                                expired.clear();
+                                lock.lock();
+                                continue;
+                        }
+                        if (index.empty())
+                                cv.wait(lock);
+                        else
+                                cv.wait_until(lock, start + std::chrono::milliseconds(NextEvent()));
+                }
+        }
+
+        Executor executor;
+        const Clock::time_point start;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::array<std::array<Slot, kSlots>, kLevels> slots;
+        // Bit i of occupied[level] is set while slots[level][i] is not empty.
+        std::array<uint64_t, kLevels> occupied;
+        std::unordered_map<TimerId, Slot::iterator> index;
+        // Last tick that has been processed.
+        uint64_t current = 0;
+        TimerId next_id = 1;
+        bool quit = false;
+        std::thread worker;
+};
+
+TimerWheel& TimerWheel::Default()
+{
+        // Both leaked so timers cancelled during static destruction stay safe.
+        // Callbacks run on a small pool, so a slow one cannot hold up the
+        // timers that expire after it.
+        static boost::asio::thread_pool* pool = new boost::asio::thread_pool(
+                std::max(2u, std::min(4u, std::thread::hardware_concurrency())));
+        static TimerWheel* wheel = new TimerWheel([](Callback&& callback)
+                {
+                        boost::asio::post(*pool, std::move(callback));
+                });
+        return *wheel;
+}
+
+TimerWheel::TimerWheel(Executor executor) : d_ptr(new Data(std::move(executor)))
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+        delete d_ptr;
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(std::chrono::milliseconds delay, Callback callback)
+{
+        return d_ptr->Add(delay, 0, std::move(callback));
+}
+
+TimerWheel::TimerId TimerWheel::ScheduleRepeating(std::chrono::milliseconds period, Callback callback)
+{
+        const uint64_t ticks = period.count() > 0 ? static_cast<uint64_t>(period.count()) : 1;
+        return d_ptr->Add(period, ticks, std::move(callback));
+}
+
+bool TimerWheel::Cancel(TimerId id)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        const auto findIt = d_ptr->index.find(id);
+        if (findIt == d_ptr->index.end())
+                return false;
+        d_ptr->Unlink(findIt->second);
+        d_ptr->index.erase(findIt);
+        return true;
+}
+
+}
@@ -210,6 +210,18 @@ namespace lsp {
             return *this;
     }
 
+    websocket_stream_wrapper& websocket_stream_wrapper::write(const const_buffer* buffers, size_t count)
+    {
+            // One call is one websocket message, so the pieces are sent as a
+            // single frame.
+            std::vector<boost::asio::const_buffer> sequence;
+            sequence.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+                    sequence.emplace_back(buffers[i].data, buffers[i].size);
+            ws_.write(sequence);
+            return *this;
+    }
+
     websocket_stream_wrapper& websocket_stream_wrapper::flush()
     {
             return *this;
@@ -38,7 +38,8 @@ void Reflect(Reader& visitor, lsRequestId& value) {
         }
         else if (visitor.IsString()) {
                 value.type = lsRequestId::kString;
-                value.k_string = visitor.GetString();
+                const string_view id = visitor.GetStringView();
+                value.k_string.assign(id.data(), id.size());
                 value.value = atoi(value.k_string.c_str());
 
         }
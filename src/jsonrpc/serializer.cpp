@@ -1,6 +1,8 @@
 #include "LibLsp/JsonRpc/serializer.h"
+#include <cstring>
 #include <stdexcept>
 #include <rapidjson/allocators.h>
+#include <rapidjson/internal/itoa.h>
 #include "LibLsp/JsonRpc/json.h"
 
 
@@ -11,10 +13,22 @@ void JsonNull::swap(JsonNull& arg) noexcept
 {
 }
 
+void Reader::Fail(const char* expected)
+{
+        if (error_->empty())
+                *error_ = expected;
+#if LSPCPP_EXCEPTIONS
+        if (throw_on_error_)
+                throw std::invalid_argument(expected);
+#endif
+}
+
 
 void Reflect(Reader& visitor, uint8_t& value) {
-  if (!visitor.IsInt())
-    throw std::invalid_argument("uint8_t");
+  if (!visitor.IsInt()) {
+    visitor.Fail("uint8_t");
+    return;
+  }
   value = (uint8_t)visitor.GetInt();
 }
 void Reflect(Writer& visitor, uint8_t& value) {
@@ -22,8 +36,10 @@ void Reflect(Writer& visitor, uint8_t& value) {
 }
 
 void Reflect(Reader& visitor, short& value) {
-  if (!visitor.IsInt())
-    throw std::invalid_argument("short");
+  if (!visitor.IsInt()) {
+    visitor.Fail("short");
+    return;
+  }
   value = (short)visitor.GetInt();
 }
 void Reflect(Writer& visitor, short& value) {
@@ -31,8 +47,10 @@ void Reflect(Writer& visitor, short& value) {
 }
 
 void Reflect(Reader& visitor, unsigned short& value) {
-  if (!visitor.IsInt())
-    throw std::invalid_argument("unsigned short");
+  if (!visitor.IsInt()) {
+    visitor.Fail("unsigned short");
+    return;
+  }
   value = (unsigned short)visitor.GetInt();
 }
 void Reflect(Writer& visitor, unsigned short& value) {
@@ -40,8 +58,10 @@ void Reflect(Writer& visitor, unsigned short& value) {
 }
 
 void Reflect(Reader& visitor, int& value) {
-  if (!visitor.IsInt())
-    throw std::invalid_argument("int");
+  if (!visitor.IsInt()) {
+    visitor.Fail("int");
+    return;
+  }
   value = visitor.GetInt();
 }
 void Reflect(Writer& visitor, int& value) {
@@ -49,8 +69,10 @@ void Reflect(Writer& visitor, int& value) {
 }
 
 void Reflect(Reader& visitor, unsigned& value) {
-  if (!visitor.IsUint64())
-    throw std::invalid_argument("unsigned");
+  if (!visitor.IsUint64()) {
+    visitor.Fail("unsigned");
+    return;
+  }
   value = visitor.GetUint32();
 }
 void Reflect(Writer& visitor, unsigned& value) {
@@ -58,8 +80,10 @@ void Reflect(Writer& visitor, unsigned& value) {
 }
 
 void Reflect(Reader& visitor, long& value) {
-  if (!visitor.IsInt64())
-    throw std::invalid_argument("long");
+  if (!visitor.IsInt64()) {
+    visitor.Fail("long");
+    return;
+  }
   value = long(visitor.GetInt64());
 }
 void Reflect(Writer& visitor, long& value) {
@@ -67,8 +91,10 @@ void Reflect(Writer& visitor, long& value) {
 }
 
 void Reflect(Reader& visitor, unsigned long& value) {
-  if (!visitor.IsUint64())
-    throw std::invalid_argument("unsigned long");
+  if (!visitor.IsUint64()) {
+    visitor.Fail("unsigned long");
+    return;
+  }
   value = (unsigned long)visitor.GetUint64();
 }
 void Reflect(Writer& visitor, unsigned long& value) {
@@ -76,8 +102,10 @@ void Reflect(Writer& visitor, unsigned long& value) {
 }
 
 void Reflect(Reader& visitor, long long& value) {
-  if (!visitor.IsInt64())
-    throw std::invalid_argument("long long");
+  if (!visitor.IsInt64()) {
+    visitor.Fail("long long");
+    return;
+  }
   value = visitor.GetInt64();
 }
 void Reflect(Writer& visitor, long long& value) {
@@ -85,8 +113,10 @@ void Reflect(Writer& visitor, long long& value) {
 }
 
 void Reflect(Reader& visitor, unsigned long long& value) {
-  if (!visitor.IsUint64())
-    throw std::invalid_argument("unsigned long long");
+  if (!visitor.IsUint64()) {
+    visitor.Fail("unsigned long long");
+    return;
+  }
   value = visitor.GetUint64();
 }
 void Reflect(Writer& visitor, unsigned long long& value) {
@@ -94,8 +124,10 @@ void Reflect(Writer& visitor, unsigned long long& value) {
 }
 
 void Reflect(Reader& visitor, double& value) {
-  if (!visitor.IsNumber())
-    throw std::invalid_argument("double");
+  if (!visitor.IsNumber()) {
+    visitor.Fail("double");
+    return;
+  }
   value = visitor.GetDouble();
 }
 void Reflect(Writer& visitor, double& value) {
@@ -103,8 +135,10 @@ void Reflect(Writer& visitor, double& value) {
 }
 
 void Reflect(Reader& visitor, bool& value) {
-  if (!visitor.IsBool())
-    throw std::invalid_argument("bool");
+  if (!visitor.IsBool()) {
+    visitor.Fail("bool");
+    return;
+  }
   value = visitor.GetBool();
 }
 void Reflect(Writer& visitor, bool& value) {
@@ -112,14 +146,23 @@ void Reflect(Writer& visitor, bool& value) {
 }
 
 void Reflect(Reader& visitor, std::string& value) {
-  if (!visitor.IsString())
-    throw std::invalid_argument("std::string");
-  value = visitor.GetString();
+  if (!visitor.IsString()) {
+    visitor.Fail("std::string");
+    return;
+  }
+  // Straight from the document into |value|, reusing its capacity. After
+  // an in-situ parse this is the only copy the string goes through.
+  const string_view text = visitor.GetStringView();
+  value.assign(text.data(), text.size());
 }
 void Reflect(Writer& visitor, std::string& value) {
   visitor.String(value.c_str(), (rapidjson::SizeType)value.size());
 }
 
+void Reflect(Writer& visitor, std::vector<int32_t>& values) {
+  visitor.IntArray(values.data(), values.size());
+}
+
 void Reflect(Reader& visitor, JsonNull& value) {
   visitor.GetNull();
 }
@@ -146,6 +189,54 @@ void Reflect(Writer& visitor, SerializeFormat& value) {
 }
 
 
+namespace
+{
+        // rapidjson::Writer keeps its output stream protected; a member pointer
+        // taken through a derived class may name it.
+        struct WriterStream : rapidjson::Writer<rapidjson::StringBuffer>
+        {
+                static rapidjson::StringBuffer& Of(rapidjson::Writer<rapidjson::StringBuffer>& writer)
+                {
+                        return *(writer.*(&WriterStream::os_));
+                }
+        };
+}
+
+void JsonWriter::IntArray(const int32_t* values, size_t count)
+{
+        // Let the writer account for an array value and emit its separator and
+        // '[', then format the elements straight into its output buffer
+        // instead of making one Int() call per element.
+        m_->RawValue("[", 1, rapidjson::kArrayType);
+        auto& output = WriterStream::Of(*m_);
+        // "-2147483648," is the longest element.
+        const size_t reserved = count * 12 + 1;
+        char* const begin = output.Push(reserved);
+        char* out = begin;
+        for (size_t i = 0; i < count; ++i)
+        {
+                if (i)
+                        *out++ = ',';
+                out = rapidjson::internal::i32toa(values[i], out);
+        }
+        *out++ = ']';
+        output.Pop(reserved - (out - begin));
+}
+
+void JsonWriter::Key(const lsp::JsonKey& key)
+{
+        if (!key.quoted)
+        {
+                m_->Key(key.name);
+                return;
+        }
+        // As in IntArray: the writer emits the separator and the opening
+        // quote, the rest of the pre-quoted name is copied in one go.
+        m_->RawValue(key.quoted, 1, rapidjson::kStringType);
+        const size_t rest = key.quoted_length - 1;
+        std::memcpy(WriterStream::Of(*m_).Push(rest), key.quoted + 1, rest);
+}
+
 std::string JsonReader::ToString() const
 {
         rapidjson::StringBuffer strBuf;
@@ -158,6 +249,10 @@ std::string JsonReader::ToString() const
 
 void JsonReader::IterMap(std::function<void(const char*, Reader&)> fn)
 {
+        if (!m_->IsObject()) {
+                Fail("object");
+                return;
+        }
         path_.push_back("0");
         for (auto& entry : m_->GetObject())
         {
@@ -172,8 +267,10 @@ void JsonReader::IterMap(std::function<void(const char*, Reader&)> fn)
 
  void JsonReader::IterArray(std::function<void(Reader&)> fn)
 {
-        if (!m_->IsArray())
-                throw std::invalid_argument("array");
+        if (!m_->IsArray()) {
+                Fail("array");
+                return;
+        }
         // Use "0" to indicate any element for now.
         path_.push_back("0");
         for (auto& entry : m_->GetArray())
@@ -0,0 +1,268 @@
+#include "LibLsp/lsp/AsyncFileWriter.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "LibLsp/lsp/utils.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <fstream>
+#else
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lsp
+{
+namespace
+{
+        std::string MakeTempName(const std::string& filename)
+        {
+                static std::atomic<unsigned> counter{ 0 };
+#ifdef _WIN32
+                const auto pid = static_cast<unsigned long>(GetCurrentProcessId());
+#else
+                const auto pid = static_cast<unsigned long>(getpid());
+#endif
+                return filename + ".lsp-" + std::to_string(pid) + "-" +
+                        std::to_string(counter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+        }
+
+#ifndef _WIN32
+        bool WriteAll(int fd, const char* data, size_t size)
+        {
+                while (size)
+                {
+                        const ssize_t n = ::write(fd, data, size);
+                        if (n < 0)
+                        {
+                                if (errno == EINTR)
+                                        continue;
+                                return false;
+                        }
+                        data += n;
+                        size -= static_cast<size_t>(n);
+                }
+                return true;
+        }
+
+        void SyncDirectory(const std::string& filename)
+        {
+                const int fd = ::open(GetDirName(filename).c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                        return;
+                ::fsync(fd);
+                ::close(fd);
+        }
+#endif
+}
+
+bool WriteToFileAtomic(const std::string& path, const std::string& content, FsyncPolicy policy)
+{
+#ifdef _WIN32
+        const std::string& filename = path;
+        const std::string temp = MakeTempName(filename);
+        {
+                std::ofstream file(temp, std::ios::out | std::ios::trunc | std::ios::binary);
+                if (!file.good())
+                        return false;
+                file.write(content.data(), content.size());
+                file.flush();
+                if (!file.good())
+                {
+                        file.close();
+                        DeleteFileW(s2ws(temp).c_str());
+                        return false;
+                }
+        }
+        DWORD flags = MOVEFILE_REPLACE_EXISTING;
+        if (policy != FsyncPolicy::None)
+                flags |= MOVEFILE_WRITE_THROUGH;
+        if (!MoveFileExW(s2ws(temp).c_str(), s2ws(filename).c_str(), flags))
+        {
+                DeleteFileW(s2ws(temp).c_str());
+                return false;
+        }
+        return true;
+#else
+        // Renaming over a symbolic link would replace the link itself; write
+        // next to the file it points to instead.
+        std::string filename = path;
+        struct stat sb;
+        if (::lstat(path.c_str(), &sb) == 0 && S_ISLNK(sb.st_mode))
+        {
+                if (char* target = ::realpath(path.c_str(), nullptr))
+                {
+                        filename = target;
+                        ::free(target);
+                }
+        }
+        const bool exists = ::stat(filename.c_str(), &sb) == 0;
+        // The temporary name is predictable, so never open something that is
+        // already there: another process may have planted a file or a link
+        // under it. Move on to the next name instead.
+        std::string temp;
+        int fd = -1;
+        for (int attempt = 0; fd < 0 && attempt < 16; ++attempt)
+        {
+                temp = MakeTempName(filename);
+                fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                        exists ? 0600 : 0644);
+                if (fd < 0 && errno != EEXIST)
+                        return false;
+        }
+        if (fd < 0)
+                return false;
+        if (exists)
+        {
+                // Keep the owner and permissions of the file we are replacing.
+                // Only root may give a file to another user; otherwise keep at
+                // least the group, and failing that the file becomes ours.
+                const bool owned = ::fchown(fd, sb.st_uid, sb.st_gid) == 0
+                        || ::fchown(fd, static_cast<uid_t>(-1), sb.st_gid) == 0;
+                (void)owned;
+                ::fchmod(fd, sb.st_mode & 07777);
+        }
+        bool ok = WriteAll(fd, content.data(), content.size());
+        if (ok && policy != FsyncPolicy::None)
+                ok = ::fsync(fd) == 0;
+        ok = ::close(fd) == 0 && ok;
+        if (!ok || ::rename(temp.c_str(), filename.c_str()) != 0)
+        {
+                ::unlink(temp.c_str());
+                return false;
+        }
+        if (policy == FsyncPolicy::FileAndDirectory)
+                SyncDirectory(filename);
+        return true;
+#endif
+}
+
+struct AsyncFileWriter::Data
+{
+        struct PendingWrite
+        {
+                std::string content;
+                std::vector<lsp::promise<bool>> waiters;
+        };
+
+        explicit Data(FsyncPolicy _policy) : policy(_policy)
+        {
+                worker = std::thread([this] { Run(); });
+        }
+
+        ~Data()
+        {
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        quit = true;
+                }
+                cv.notify_all();
+                if (worker.joinable())
+                        worker.join();
+        }
+
+        void Run()
+        {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                        cv.wait(lock, [this] { return quit || !order.empty(); });
+                        if (order.empty())
+                                return;
+
+                        std::string filename = std::move(order.front());
+                        order.pop_front();
+                        auto findIt = pending.find(filename);
+                        PendingWrite write = std::move(findIt->second);
+                        pending.erase(findIt);
+                        ++in_flight;
+                        const FsyncPolicy current_policy = policy;
+
+                        // Slow storage must never hold up new saves being queued.
+                        lock.unlock();
+                        const bool result = WriteToFileAtomic(filename, write.content, current_policy);
+                        for (auto& waiter : write.waiters)
+                                waiter.set_value(result);
+                        lock.lock();
+
+                        --in_flight;
+                        if (order.empty() && !in_flight)
+                                idle_cv.notify_all();
+                }
+        }
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::condition_variable idle_cv;
+        // Each queued file appears once in |order|; later saves replace the
+        // content held in |pending|.
+        std::deque<std::string> order;
+        std::unordered_map<std::string, PendingWrite> pending;
+        unsigned in_flight = 0;
+        bool quit = false;
+        FsyncPolicy policy;
+        std::thread worker;
+};
+
+AsyncFileWriter::AsyncFileWriter(FsyncPolicy policy) : d_ptr(new Data(policy))
+{
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+        delete d_ptr;
+}
+
+lsp::future<bool> AsyncFileWriter::Write(const std::string& filename, std::string&& content)
+{
+        lsp::promise<bool> waiter;
+        auto result = waiter.get_future();
+        {
+                std::lock_guard<std::mutex> lock(d_ptr->mutex);
+                auto findIt = d_ptr->pending.find(filename);
+                if (findIt != d_ptr->pending.end())
+                {
+                        findIt->second.content.swap(content);
+                        findIt->second.waiters.push_back(std::move(waiter));
+                }
+                else
+                {
+                        auto& write = d_ptr->pending[filename];
+                        write.content.swap(content);
+                        write.waiters.push_back(std::move(waiter));
+                        d_ptr->order.push_back(filename);
+                }
+        }
+        d_ptr->cv.notify_one();
+        return result;
+}
+
+void AsyncFileWriter::Flush()
+{
+        std::unique_lock<std::mutex> lock(d_ptr->mutex);
+        d_ptr->idle_cv.wait(lock, [this] { return d_ptr->order.empty() && !d_ptr->in_flight; });
+}
+
+void AsyncFileWriter::SetFsyncPolicy(FsyncPolicy policy)
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        d_ptr->policy = policy;
+}
+
+FsyncPolicy AsyncFileWriter::GetFsyncPolicy() const
+{
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        return d_ptr->policy;
+}
+
+}
@@ -0,0 +1,431 @@
+#include "LibLsp/lsp/FileWatcher.h"
+
+#include "LibLsp/lsp/AbsolutePath.h"
+#include "LibLsp/lsp/GlobSet.h"
+
+#ifdef __linux__
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lsp
+{
+#ifdef __linux__
+
+namespace
+{
+        constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE |
+                IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+        std::string JoinPath(const std::string& dir, const char* name)
+        {
+                std::string path = dir;
+                if (path.empty() || path.back() != '/')
+                        path += '/';
+                path += name;
+                return path;
+        }
+}
+
+struct FileWatcher::Data
+{
+        using Clock = std::chrono::steady_clock;
+
+        struct Watch
+        {
+                std::string path;
+                std::string root;
+        };
+
+        struct PendingChange
+        {
+                lsFileChangeType type;
+                Clock::time_point deadline;
+        };
+
+        Data(lsp::Log& _log, Callback&& _callback, const FileWatcherOptions& _options)
+                : log(_log), callback(std::move(_callback)), options(_options)
+        {
+                for (auto& glob : options.exclude_globs)
+                {
+                        if (glob.find('/') != std::string::npos)
+                                path_globs.Add(glob);
+                        else
+                                name_globs.Add(glob);
+                }
+                path_globs.Build();
+                name_globs.Build();
+                for (auto& glob : options.include_globs)
+                        include_globs.Add(glob);
+                include_globs.Build();
+                inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                if (inotify_fd < 0)
+                {
+                        log.log(lsp::Log::Level::SEVERE, std::string("inotify is unavailable: ") + strerror(errno));
+                        return;
+                }
+                wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (wake_fd < 0)
+                {
+                        log.log(lsp::Log::Level::SEVERE, std::string("eventfd failed: ") + strerror(errno));
+                        // Without a worker nothing would ever be reported; make
+                        // AddRoot fail instead of watching in vain.
+                        ::close(inotify_fd);
+                        inotify_fd = -1;
+                        return;
+                }
+                worker = std::thread([this] { Run(); });
+        }
+
+        ~Data()
+        {
+                quit.store(true, std::memory_order_release);
+                if (wake_fd >= 0)
+                {
+                        const uint64_t one = 1;
+                        ssize_t ignored = ::write(wake_fd, &one, sizeof one);
+                        (void)ignored;
+                }
+                if (worker.joinable())
+                        worker.join();
+                if (inotify_fd >= 0)
+                        ::close(inotify_fd);
+                if (wake_fd >= 0)
+                        ::close(wake_fd);
+        }
+
+        bool IsExcluded(const std::string& root, const std::string& path, const char* name) const
+        {
+                if (!name_globs.empty() && name_globs.IsMatch(name))
+                        return true;
+                if (path_globs.empty() || path.size() <= root.size() + 1)
+                        return false;
+                return path_globs.IsMatch(string_view(path).substr(root.size() + 1));
+        }
+
+        // Watches |top| and every non-excluded directory below it. When
+        // |report_created| is set, everything found is recorded as created; this
+        // covers files that appeared before the new watches were in place.
+        bool AddTree(const std::string& root, const std::string& top, bool report_created)
+        {
+                std::vector<std::string> stack{ top };
+                bool added_top = false;
+                while (!stack.empty())
+                {
+                        std::string dir = std::move(stack.back());
+                        stack.pop_back();
+                        const int wd = inotify_add_watch(inotify_fd, dir.c_str(), kWatchMask);
+                        if (wd < 0)
+                        {
+                                if (errno == ENOSPC && !warned_watch_limit.exchange(true))
+                                        log.log(lsp::Log::Level::WARNING,
+                                                "inotify watch limit reached, raise fs.inotify.max_user_watches");
+                                continue;
+                        }
+                        if (dir == top)
+                                added_top = true;
+                        {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                watches[wd] = Watch{ dir, root };
+                        }
+
+                        DIR* handle = opendir(dir.c_str());
+                        if (!handle)
+                                continue;
+                        while (dirent* entry = readdir(handle))
+                        {
+                                const char* name = entry->d_name;
+                                if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+                                        continue;
+                                std::string path = JoinPath(dir, name);
+                                if (IsExcluded(root, path, name))
+                                        continue;
+                                unsigned char type = entry->d_type;
+                                if (type == DT_UNKNOWN)
+                                {
+                                        struct stat sb;
+                                        if (fstatat(dirfd(handle), name, &sb, AT_SYMLINK_NOFOLLOW) != 0)
+                                                continue;
+                                        type = S_ISDIR(sb.st_mode) ? DT_DIR : DT_REG;
+                                }
+                                if (report_created)
+                                        Record(path, lsFileChangeType::Created, Clock::now());
+                                if (type == DT_DIR)
+                                        stack.push_back(std::move(path));
+                        }
+                        closedir(handle);
+                }
+                return added_top;
+        }
+
+        // Drops the watches of |top| and everything below it.
+        void RemoveTree(const std::string& top)
+        {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto it = watches.begin(); it != watches.end();)
+                {
+                        const auto& path = it->second.path;
+                        if (path.compare(0, top.size(), top) == 0 &&
+                                (path.size() == top.size() || path[top.size()] == '/'))
+                        {
+                                inotify_rm_watch(inotify_fd, it->first);
+                                it = watches.erase(it);
+                        }
+                        else
+                        {
+                                ++it;
+                        }
+                }
+        }
+
+        void Record(const std::string& path, lsFileChangeType type, Clock::time_point now)
+        {
+                if (!include_globs.empty() && !include_globs.IsMatch(path))
+                        return;
+                const auto deadline = now + options.debounce;
+                auto findIt = pending.find(path);
+                if (findIt == pending.end())
+                {
+                        pending.emplace(path, PendingChange{ type, deadline });
+                        return;
+                }
+                auto& change = findIt->second;
+                if (change.type == lsFileChangeType::Created && type == lsFileChangeType::Deleted)
+                {
+                        // Came and went within one debounce window.
+                        pending.erase(findIt);
+                        return;
+                }
+                if (change.type == lsFileChangeType::Created && type == lsFileChangeType::Changed)
+                        type = lsFileChangeType::Created;
+                else if (change.type == lsFileChangeType::Deleted && type == lsFileChangeType::Created)
+                        type = lsFileChangeType::Changed;
+                change.type = type;
+                change.deadline = deadline;
+        }
+
+        void Handle(const inotify_event& event)
+        {
+                if (event.mask & IN_Q_OVERFLOW)
+                {
+                        log.log(lsp::Log::Level::WARNING, "inotify queue overflowed, some file changes were lost");
+                        return;
+                }
+                Watch watch;
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        const auto findIt = watches.find(event.wd);
+                        if (findIt == watches.end())
+                                return;
+                        if (event.mask & IN_IGNORED)
+                        {
+                                watches.erase(findIt);
+                                return;
+                        }
+                        watch = findIt->second;
+                }
+                if (!event.len)
+                        return;
+
+                const std::string path = JoinPath(watch.path, event.name);
+                if (IsExcluded(watch.root, path, event.name))
+                        return;
+                const bool is_dir = (event.mask & IN_ISDIR) != 0;
+                const auto now = Clock::now();
+                if (event.mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                        Record(path, lsFileChangeType::Created, now);
+                        if (is_dir)
+                                AddTree(watch.root, path, true);
+                }
+                else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+                {
+                        Record(path, lsFileChangeType::Deleted, now);
+                        if (is_dir && (event.mask & IN_MOVED_FROM))
+                                RemoveTree(path);
+                }
+                else if (!is_dir && (event.mask & (IN_MODIFY | IN_CLOSE_WRITE)))
+                {
+                        Record(path, lsFileChangeType::Changed, now);
+                }
+        }
+
+        void Flush(Clock::time_point now)
+        {
+                lsDidChangeWatchedFilesParams params;
+                for (auto it = pending.begin(); it != pending.end();)
+                {
+                        if (it->second.deadline > now)
+                        {
+                                ++it;
+                                continue;
+                        }
+                        lsFileEvent event;
+                        event.uri = lsDocumentUri::FromPath(AbsolutePath(it->first, false));
+                        event.type = it->second.type;
+                        params.changes.push_back(std::move(event));
+                        it = pending.erase(it);
+                }
+                if (!params.changes.empty() && callback)
+                        callback(params);
+        }
+
+        int NextTimeout(Clock::time_point now) const
+        {
+                if (pending.empty())
+                        return -1;
+                auto earliest = Clock::time_point::max();
+                for (auto& it : pending)
+                        earliest = std::min(earliest, it.second.deadline);
+                if (earliest <= now)
+                        return 0;
+                return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(earliest - now).count()) + 1;
+        }
+
+        void Run()
+        {
+                alignas(inotify_event) char buffer[64 * 1024];
+                while (!quit.load(std::memory_order_acquire))
+                {
+                        pollfd fds[2] = { { inotify_fd, POLLIN, 0 }, { wake_fd, POLLIN, 0 } };
+                        const int ready = poll(fds, 2, NextTimeout(Clock::now()));
+                        if (ready < 0 && errno != EINTR)
+                                break;
+                        if (ready > 0 && (fds[0].revents & POLLIN))
+                        {
+                                for (;;)
+                                {
+                                        const ssize_t n = ::read(inotify_fd, buffer, sizeof buffer);
+                                        if (n <= 0)
+                                                break;
+                                        for (ssize_t offset = 0; offset < n;)
+                                        {
+                                                const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                                                Handle(*event);
+                                                offset += sizeof(inotify_event) + event->len;
+                                        }
+                                }
+                        }
+                        Flush(Clock::now());
+                }
+        }
+
+        lsp::Log& log;
+        Callback callback;
+        FileWatcherOptions options;
+        GlobSet name_globs;
+        GlobSet path_globs;
+        GlobSet include_globs;
+
+        int inotify_fd = -1;
+        int wake_fd = -1;
+        std::atomic<bool> quit{ false };
+        std::atomic<bool> warned_watch_limit{ false };
+
+        std::mutex mutex;  // Protects |watches|.
+        std::unordered_map<int, Watch> watches;
+        // Only touched by the watcher thread.
+        std::unordered_map<std::string, PendingChange> pending;
+        std::thread worker;
+};
+
+FileWatcher::FileWatcher(lsp::Log& log, Callback callback, const FileWatcherOptions& options)
+        : d_ptr(new Data(log, std::move(callback), options))
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+        delete d_ptr;
+}
+
+bool FileWatcher::AddRoot(const std::string& root)
+{
+        if (d_ptr->inotify_fd < 0 || root.empty())
+                return false;
+        std::string top = root;
+        while (top.size() > 1 && top.back() == '/')
+                top.pop_back();
+        return d_ptr->AddTree(top, top, false);
+}
+
+void FileWatcher::RemoveRoot(const std::string& root)
+{
+        std::string top = root;
+        while (top.size() > 1 && top.back() == '/')
+                top.pop_back();
+        std::lock_guard<std::mutex> lock(d_ptr->mutex);
+        for (auto it = d_ptr->watches.begin(); it != d_ptr->watches.end();)
+        {
+                if (it->second.root == top)
+                {
+                        inotify_rm_watch(d_ptr->inotify_fd, it->first);
+                        it = d_ptr->watches.erase(it);
+                }
+                else
+                {
+                        ++it;
+                }
+        }
+}
+
+bool FileWatcher::IsSupported()
+{
+        // inotify may be compiled out, or its instance limit reached.
+        static const bool supported = []
+        {
+                const int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                const int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (inotify_fd >= 0)
+                        ::close(inotify_fd);
+                if (wake_fd >= 0)
+                        ::close(wake_fd);
+                return inotify_fd >= 0 && wake_fd >= 0;
+        }();
+        return supported;
+}
+
+#else
+
+struct FileWatcher::Data
+{
+};
+
+FileWatcher::FileWatcher(lsp::Log&, Callback, const FileWatcherOptions&) : d_ptr(new Data())
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+        delete d_ptr;
+}
+
+bool FileWatcher::AddRoot(const std::string&)
+{
+        return false;
+}
+
+void FileWatcher::RemoveRoot(const std::string&)
+{
+}
+
+bool FileWatcher::IsSupported()
+{
+        return false;
+}
+
+#endif
+}
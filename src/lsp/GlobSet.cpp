@@ -0,0 +1,437 @@
+#include "LibLsp/lsp/GlobSet.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+
+namespace lsp
+{
+namespace
+{
+        using ByteSet = std::array<uint64_t, 4>;
+
+        void Insert(ByteSet& set, unsigned char c)
+        {
+                set[c >> 6] |= uint64_t(1) << (c & 63);
+        }
+        void Erase(ByteSet& set, unsigned char c)
+        {
+                set[c >> 6] &= ~(uint64_t(1) << (c & 63));
+        }
+        bool Contains(const ByteSet& set, unsigned char c)
+        {
+                return (set[c >> 6] >> (c & 63)) & 1;
+        }
+
+        ByteSet AnyByte()
+        {
+                ByteSet set;
+                set.fill(~uint64_t(0));
+                return set;
+        }
+        ByteSet AnyButSlash()
+        {
+                ByteSet set = AnyByte();
+                Erase(set, '/');
+                return set;
+        }
+        ByteSet OnlySlash()
+        {
+                ByteSet set{};
+                Insert(set, '/');
+                return set;
+        }
+
+        // Expands the first top-level {a,b} group of |pattern| and recurses into
+        // each alternative. Unbalanced braces are taken literally.
+        void ExpandBraces(const std::string& pattern, std::vector<std::string>& out)
+        {
+                size_t open = std::string::npos;
+                size_t close = std::string::npos;
+                int depth = 0;
+                for (size_t i = 0; i < pattern.size() && close == std::string::npos; ++i)
+                {
+                        if (pattern[i] == '{')
+                        {
+                                if (depth++ == 0)
+                                        open = i;
+                        }
+                        else if (pattern[i] == '}' && depth > 0)
+                        {
+                                if (--depth == 0)
+                                        close = i;
+                        }
+                }
+                if (close == std::string::npos)
+                {
+                        out.push_back(pattern);
+                        return;
+                }
+
+                const std::string prefix = pattern.substr(0, open);
+                const std::string suffix = pattern.substr(close + 1);
+                size_t start = open + 1;
+                depth = 0;
+                for (size_t i = open + 1; i <= close; ++i)
+                {
+                        const char c = pattern[i];
+                        if (c == '{')
+                                ++depth;
+                        else if (c == '}' && depth > 0)
+                                --depth;
+                        else if ((c == ',' && depth == 0) || i == close)
+                        {
+                                ExpandBraces(prefix + pattern.substr(start, i - start) + suffix, out);
+                                start = i + 1;
+                        }
+                }
+        }
+
+        // Parses the class starting at pattern[i] == '['. Returns false if it is
+        // not terminated, in which case '[' is a literal.
+        bool ParseClass(const std::string& pattern, size_t& i, ByteSet& set)
+        {
+                size_t j = i + 1;
+                const bool negate = j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^');
+                if (negate)
+                        ++j;
+                ByteSet parsed{};
+                bool first = true;
+                while (j < pattern.size() && (first || pattern[j] != ']'))
+                {
+                        first = false;
+                        const unsigned char lo = pattern[j];
+                        unsigned char hi = lo;
+                        if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']')
+                        {
+                                hi = pattern[j + 2];
+                                j += 3;
+                        }
+                        else
+                        {
+                                ++j;
+                        }
+                        for (unsigned c = lo; c <= hi; ++c)
+                                Insert(parsed, static_cast<unsigned char>(c));
+                }
+                if (j >= pattern.size())
+                        return false;
+                if (negate)
+                {
+                        for (auto& word : parsed)
+                                word = ~word;
+                }
+                Erase(parsed, '/');
+                set = parsed;
+                i = j + 1;
+                return true;
+        }
+
+        // Past this many states the DFA is abandoned and paths are matched by
+        // simulating the NFA instead.
+        constexpr size_t kMaxDfaStates = 4096;
+}
+
+struct GlobSet::Data
+{
+        struct NfaState
+        {
+                // (index into |sets|, target state)
+                std::vector<std::pair<uint32_t, uint32_t>> edges;
+                std::vector<uint32_t> epsilons;
+                int32_t accept = -1;
+        };
+
+        Data()
+        {
+                nfa.emplace_back();
+        }
+
+        uint32_t NewState()
+        {
+                nfa.emplace_back();
+                return static_cast<uint32_t>(nfa.size() - 1);
+        }
+
+        void AddEdge(uint32_t from, const ByteSet& set, uint32_t to)
+        {
+                auto inserted = set_ids.emplace(set, static_cast<uint32_t>(sets.size()));
+                if (inserted.second)
+                        sets.push_back(set);
+                nfa[from].edges.emplace_back(inserted.first->second, to);
+        }
+
+        void Compile(const std::string& pattern, int32_t id)
+        {
+                uint32_t cur = NewState();
+                nfa[0].epsilons.push_back(cur);
+                size_t i = 0;
+                while (i < pattern.size())
+                {
+                        if (pattern[i] == '*')
+                        {
+                                if (i + 1 < pattern.size() && pattern[i + 1] == '*')
+                                {
+                                        i += 2;
+                                        if (i < pattern.size() && pattern[i] == '/')
+                                        {
+                                                // '**/' is either nothing or anything ending in '/'.
+                                                ++i;
+                                                const uint32_t inside = NewState();
+                                                const uint32_t after = NewState();
+                                                AddEdge(cur, AnyByte(), inside);
+                                                AddEdge(inside, AnyByte(), inside);
+                                                AddEdge(inside, OnlySlash(), after);
+                                                AddEdge(cur, OnlySlash(), after);
+                                                nfa[cur].epsilons.push_back(after);
+                                                cur = after;
+                                        }
+                                        else
+                                        {
+                                                AddEdge(cur, AnyByte(), cur);
+                                        }
+                                }
+                                else
+                                {
+                                        ++i;
+                                        AddEdge(cur, AnyButSlash(), cur);
+                                }
+                                continue;
+                        }
+
+                        ByteSet set{};
+                        if (pattern[i] == '?')
+                        {
+                                set = AnyButSlash();
+                                ++i;
+                        }
+                        else if (pattern[i] != '[' || !ParseClass(pattern, i, set))
+                        {
+                                Insert(set, static_cast<unsigned char>(pattern[i]));
+                                ++i;
+                        }
+                        const uint32_t next = NewState();
+                        AddEdge(cur, set, next);
+                        cur = next;
+                }
+                nfa[cur].accept = id;
+        }
+
+        void Closure(std::vector<uint32_t>& states) const
+        {
+                std::vector<uint32_t> stack(states);
+                while (!stack.empty())
+                {
+                        const uint32_t state = stack.back();
+                        stack.pop_back();
+                        for (auto next : nfa[state].epsilons)
+                        {
+                                if (std::find(states.begin(), states.end(), next) == states.end())
+                                {
+                                        states.push_back(next);
+                                        stack.push_back(next);
+                                }
+                        }
+                }
+                std::sort(states.begin(), states.end());
+        }
+
+        void Step(const std::vector<uint32_t>& from, unsigned char c, std::vector<uint32_t>& to) const
+        {
+                to.clear();
+                for (auto state : from)
+                {
+                        for (auto& edge : nfa[state].edges)
+                        {
+                                if (Contains(sets[edge.first], c))
+                                        to.push_back(edge.second);
+                        }
+                }
+                std::sort(to.begin(), to.end());
+                to.erase(std::unique(to.begin(), to.end()), to.end());
+                Closure(to);
+        }
+
+        std::vector<uint32_t> AcceptsOf(const std::vector<uint32_t>& states) const
+        {
+                std::vector<uint32_t> result;
+                for (auto state : states)
+                {
+                        if (nfa[state].accept >= 0)
+                                result.push_back(static_cast<uint32_t>(nfa[state].accept));
+                }
+                std::sort(result.begin(), result.end());
+                result.erase(std::unique(result.begin(), result.end()), result.end());
+                return result;
+        }
+
+        void BuildDfa()
+        {
+                // Bytes that no edge set tells apart share one column in the table.
+                std::map<std::vector<bool>, uint16_t> classes;
+                std::vector<unsigned char> representatives;
+                for (unsigned c = 0; c < 256; ++c)
+                {
+                        std::vector<bool> signature(sets.size());
+                        for (size_t k = 0; k < sets.size(); ++k)
+                                signature[k] = Contains(sets[k], static_cast<unsigned char>(c));
+                        auto inserted = classes.emplace(std::move(signature), static_cast<uint16_t>(classes.size()));
+                        if (inserted.second)
+                                representatives.push_back(static_cast<unsigned char>(c));
+                        byte_class[c] = inserted.first->second;
+                }
+                class_count = representatives.size();
+
+                std::map<std::vector<uint32_t>, uint32_t> ids;
+                std::vector<std::vector<uint32_t>> states;
+                auto intern = [&](std::vector<uint32_t>&& set) -> uint32_t
+                {
+                        auto inserted = ids.emplace(set, static_cast<uint32_t>(states.size()));
+                        if (inserted.second)
+                                states.push_back(std::move(set));
+                        return inserted.first->second;
+                };
+                intern({});  // 0 is the dead state.
+                std::vector<uint32_t> start{ 0 };
+                Closure(start);
+                start_state = intern(std::move(start));
+
+                transitions.clear();
+                std::vector<uint32_t> next;
+                for (size_t index = 0; index < states.size(); ++index)
+                {
+                        if (states.size() > kMaxDfaStates)
+                        {
+                                use_dfa = false;
+                                transitions.clear();
+                                accepts.clear();
+                                return;
+                        }
+                        for (auto representative : representatives)
+                        {
+                                Step(states[index], representative, next);
+                                transitions.push_back(intern(std::move(next)));
+                                next = {};
+                        }
+                }
+                accepts.resize(states.size());
+                for (size_t index = 0; index < states.size(); ++index)
+                        accepts[index] = AcceptsOf(states[index]);
+                use_dfa = true;
+        }
+
+        uint32_t Walk(const string_view& path) const
+        {
+                uint32_t state = start_state;
+                for (char c : path)
+                {
+                        state = transitions[state * class_count + byte_class[static_cast<unsigned char>(c)]];
+                        if (!state)
+                                break;
+                }
+                return state;
+        }
+
+        std::vector<uint32_t> Run(const string_view& path) const
+        {
+                if (!built)
+                        return {};
+                if (use_dfa)
+                        return accepts[Walk(path)];
+                std::vector<uint32_t> current{ 0 }, next;
+                Closure(current);
+                for (char c : path)
+                {
+                        Step(current, static_cast<unsigned char>(c), next);
+                        if (next.empty())
+                                return {};
+                        current.swap(next);
+                }
+                return AcceptsOf(current);
+        }
+
+        std::vector<std::string> patterns;
+        std::vector<NfaState> nfa;
+        std::vector<ByteSet> sets;
+        std::map<ByteSet, uint32_t> set_ids;
+
+        bool built = false;
+        bool use_dfa = false;
+        std::array<uint16_t, 256> byte_class{};
+        size_t class_count = 0;
+        uint32_t start_state = 0;
+        // Row-major [state][byte class]; state 0 never matches.
+        std::vector<uint32_t> transitions;
+        std::vector<std::vector<uint32_t>> accepts;
+};
+
+GlobSet::GlobSet() : d_ptr(new Data())
+{
+}
+
+GlobSet::GlobSet(const std::vector<std::string>& patterns) : d_ptr(new Data())
+{
+        for (auto& pattern : patterns)
+                Add(pattern);
+        Build();
+}
+
+GlobSet::~GlobSet()
+{
+        delete d_ptr;
+}
+
+GlobSet::GlobSet(GlobSet&& other) noexcept : d_ptr(other.d_ptr)
+{
+        other.d_ptr = new Data();
+}
+
+GlobSet& GlobSet::operator=(GlobSet&& other) noexcept
+{
+        std::swap(d_ptr, other.d_ptr);
+        return *this;
+}
+
+size_t GlobSet::Add(const std::string& pattern)
+{
+        const size_t id = d_ptr->patterns.size();
+        d_ptr->patterns.push_back(pattern);
+        std::vector<std::string> expanded;
+        ExpandBraces(pattern, expanded);
+        for (auto& alternative : expanded)
+                d_ptr->Compile(alternative, static_cast<int32_t>(id));
+        d_ptr->built = false;
+        return id;
+}
+
+void GlobSet::Build()
+{
+        d_ptr->BuildDfa();
+        d_ptr->built = true;
+}
+
+bool GlobSet::empty() const
+{
+        return d_ptr->patterns.empty();
+}
+
+size_t GlobSet::size() const
+{
+        return d_ptr->patterns.size();
+}
+
+bool GlobSet::IsMatch(const string_view& path) const
+{
+        if (d_ptr->built && d_ptr->use_dfa)
+                return !d_ptr->accepts[d_ptr->Walk(path)].empty();
+        return !d_ptr->Run(path).empty();
+}
+
+std::vector<size_t> GlobSet::Matches(const string_view& path) const
+{
+        const auto ids = d_ptr->Run(path);
+        return std::vector<size_t>(ids.begin(), ids.end());
+}
+
+}
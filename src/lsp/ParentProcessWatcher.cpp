@@ -1,10 +1,9 @@
 #include "LibLsp/lsp/ParentProcessWatcher.h"
 #include <algorithm>
-#include <boost/process.hpp>
 
 #ifdef _WIN32
+#include <boost/process.hpp>
 #include <boost/process/windows.hpp>
-#endif
 
 #include <boost/filesystem.hpp>
 #include <boost/asio.hpp>
@@ -105,3 +104,282 @@ ParentProcessWatcher::~ParentProcessWatcher()
         if (d_ptr->timer)
                 d_ptr->timer->Stop();
 }
+
+#else
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "LibLsp/JsonRpc/TimerWheel.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#endif
+
+namespace
+{
+        int OpenPidFd(int pid)
+        {
+#ifdef __linux__
+                return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+                (void)pid;
+                errno = ENOSYS;
+                return -1;
+#endif
+        }
+
+        bool ProcessIsGone(int pid)
+        {
+                return kill(pid, 0) != 0 && errno == ESRCH;
+        }
+
+        // One thread waits for every watched process. On Linux a pidfd becomes
+        // readable the moment its process exits; where pidfd_open is missing, or
+        // the thread cannot wait on its descriptors, the process is probed with
+        // kill(pid, 0) from a TimerWheel timer instead.
+        class ProcessExitReactor
+        {
+        public:
+                static ProcessExitReactor& Instance()
+                {
+                        // Leaked so watchers destroyed during static destruction stay safe.
+                        static ProcessExitReactor* reactor = new ProcessExitReactor();
+                        return *reactor;
+                }
+
+                uint64_t Watch(lsp::Log& log, int pid, std::function<void()> on_exit, std::chrono::milliseconds poll_interval)
+                {
+                        Entry entry;
+                        entry.pid = pid;
+                        entry.pidfd = OpenPidFd(pid);
+                        if (entry.pidfd < 0)
+                        {
+                                const int error = errno;
+                                if (error == ESRCH || ProcessIsGone(pid))
+                                {
+                                        Fire(std::move(on_exit));
+                                        return 0;
+                                }
+                                if (error != ENOSYS && error != EPERM)
+                                        log.log(lsp::Log::Level::WARNING,
+                                                "pidfd_open failed, polling parent process " + std::to_string(pid));
+                        }
+                        entry.log = &log;
+                        entry.on_exit = std::move(on_exit);
+                        entry.poll_interval = poll_interval;
+
+                        uint64_t id;
+                        bool has_pidfd;
+                        {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                id = next_id++;
+                                if (entry.pidfd >= 0 && !reactor_error.empty())
+                                {
+                                        log.log(lsp::Log::Level::WARNING, reactor_error + ", polling parent process "
+                                                + std::to_string(pid));
+                                        close(entry.pidfd);
+                                        entry.pidfd = -1;
+                                }
+                                has_pidfd = entry.pidfd >= 0;
+                                if (!has_pidfd)
+                                        StartPolling(id, entry);
+                                entries.emplace(id, std::move(entry));
+                        }
+                        if (has_pidfd)
+                                Wake();
+                        return id;
+                }
+
+                void Unwatch(uint64_t id)
+                {
+                        {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                const auto findIt = entries.find(id);
+                                if (findIt == entries.end())
+                                        return;
+                                if (findIt->second.pidfd >= 0)
+                                        close(findIt->second.pidfd);
+                                else
+                                        lsp::TimerWheel::Default().Cancel(findIt->second.poll_timer);
+                                entries.erase(findIt);
+                        }
+                        Wake();
+                }
+
+        private:
+                struct Entry
+                {
+                        int pid = 0;
+                        int pidfd = -1;
+                        lsp::Log* log = nullptr;
+                        std::function<void()> on_exit;
+                        std::chrono::milliseconds poll_interval{ 0 };
+                        lsp::TimerWheel::TimerId poll_timer = 0;
+                };
+
+                ProcessExitReactor()
+                {
+                        if (pipe(wake_pipe) != 0)
+                        {
+                                // Without a way to wake it, the thread could not pick up
+                                // new pidfds; every process is polled instead.
+                                reactor_error = std::string("pipe() failed: ") + strerror(errno);
+                                return;
+                        }
+                        for (int fd : wake_pipe)
+                        {
+                                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                                fcntl(fd, F_SETFD, FD_CLOEXEC);
+                        }
+                        std::thread([this] { Run(); }).detach();
+                }
+
+                // Called with |mutex| held.
+                void StartPolling(uint64_t id, Entry& entry)
+                {
+                        entry.poll_timer = lsp::TimerWheel::Default().ScheduleRepeating(entry.poll_interval,
+                                [this, id] { Probe(id); });
+                }
+
+                // Called by Run() before it returns for good.
+                void FallBackToPolling(const std::string& error)
+                {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        reactor_error = error;
+                        for (auto& it : entries)
+                        {
+                                auto& entry = it.second;
+                                if (entry.pidfd < 0)
+                                        continue;
+                                entry.log->log(lsp::Log::Level::WARNING, error + ", polling parent process "
+                                        + std::to_string(entry.pid));
+                                close(entry.pidfd);
+                                entry.pidfd = -1;
+                                StartPolling(it.first, entry);
+                        }
+                }
+
+                void Wake()
+                {
+                        const char byte = 0;
+                        ssize_t ignored = write(wake_pipe[1], &byte, 1);
+                        (void)ignored;
+                }
+
+                void Probe(uint64_t id)
+                {
+                        std::function<void()> on_exit;
+                        {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                const auto findIt = entries.find(id);
+                                if (findIt == entries.end() || !ProcessIsGone(findIt->second.pid))
+                                        return;
+                                lsp::TimerWheel::Default().Cancel(findIt->second.poll_timer);
+                                on_exit = std::move(findIt->second.on_exit);
+                                entries.erase(findIt);
+                        }
+                        Fire(std::move(on_exit));
+                }
+
+                static void Fire(std::function<void()>&& on_exit)
+                {
+                        // on_exit usually tears the server down; keep it off the reactor.
+                        if (on_exit)
+                                std::thread(std::move(on_exit)).detach();
+                }
+
+                void Run()
+                {
+                        std::vector<pollfd> fds;
+                        std::vector<uint64_t> ids;
+                        std::vector<std::function<void()>> exited;
+                        for (;;)
+                        {
+                                fds.assign(1, pollfd{ wake_pipe[0], POLLIN, 0 });
+                                ids.assign(1, 0);
+                                {
+                                        std::lock_guard<std::mutex> lock(mutex);
+                                        for (auto& it : entries)
+                                        {
+                                                if (it.second.pidfd < 0)
+                                                        continue;
+                                                fds.push_back(pollfd{ it.second.pidfd, POLLIN, 0 });
+                                                ids.push_back(it.first);
+                                        }
+                                }
+
+                                if (poll(fds.data(), fds.size(), -1) < 0)
+                                {
+                                        if (errno == EINTR)
+                                                continue;
+                                        // Retrying would only fail again, at full speed.
+                                        FallBackToPolling(std::string("poll() failed: ") + strerror(errno));
+                                        return;
+                                }
+                                char drain[64];
+                                while (read(wake_pipe[0], drain, sizeof drain) > 0)
+                                {
+                                }
+
+                                {
+                                        std::lock_guard<std::mutex> lock(mutex);
+                                        for (size_t i = 1; i < fds.size(); ++i)
+                                        {
+                                                if (!fds[i].revents)
+                                                        continue;
+                                                const auto findIt = entries.find(ids[i]);
+                                                if (findIt == entries.end())
+                                                        continue;
+                                                close(findIt->second.pidfd);
+                                                exited.push_back(std::move(findIt->second.on_exit));
+                                                entries.erase(findIt);
+                                        }
+                                }
+                                for (auto& on_exit : exited)
+                                        Fire(std::move(on_exit));
+                                exited.clear();
+                        }
+                }
+
+                std::mutex mutex;
+                std::unordered_map<uint64_t, Entry> entries;
+                uint64_t next_id = 1;
+                int wake_pipe[2] = { -1, -1 };
+                // Why Run() is not waiting on pidfds, empty while it is. Guarded
+                // by |mutex| once Run() has started.
+                std::string reactor_error;
+        };
+}
+
+struct ParentProcessWatcher::ParentProcessWatcherData
+{
+        uint64_t watch_id = 0;
+};
+
+ParentProcessWatcher::ParentProcessWatcher(lsp::Log& log, int pid,
+        const std::function<void()>&& callback, uint32_t  poll_delay_secs) : d_ptr(std::make_shared<ParentProcessWatcherData>())
+{
+        d_ptr->watch_id = ProcessExitReactor::Instance().Watch(log, pid, callback,
+                std::chrono::seconds(poll_delay_secs));
+}
+
+ParentProcessWatcher::~ParentProcessWatcher()
+{
+        if (d_ptr->watch_id)
+                ProcessExitReactor::Instance().Unwatch(d_ptr->watch_id);
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include "LibLsp/lsp/SemanticTokensCache.h"
+
+#include <atomic>
+#include <memory>
+
+#include "LibLsp/JsonRpc/MemoryBudget.h"
+#include "LibLsp/lsp/lru_cache.h"
+#include "LibLsp/lsp/UriTable.h"
+
+namespace lsp
+{
+namespace
+{
+        struct Entry
+        {
+                std::string result_id;
+                // Shared with the SemanticTokens returned by Full().
+                std::shared_ptr<const std::vector<SemanticToken>> tokens;
+        };
+}
+
+struct SemanticTokensCache::Data
+{
+        using Cache = ConcurrentLruCache<UriTable::UriId, std::shared_ptr<const Entry>>;
+
+        explicit Data(size_t max_documents)
+                : entries(static_cast<int>(max_documents), 0,
+                        [](const UriTable::UriId&, const std::shared_ptr<const Entry>& entry)
+                        {
+                                return entry->result_id.size() + entry->tokens->size() * sizeof(SemanticToken);
+                        })
+        {
+        }
+
+        void Store(UriTable::UriId id, std::shared_ptr<const Entry> entry)
+        {
+                entries.Insert(id, entry);
+                memory->Set(entries.bytes());
+        }
+
+        std::string NextResultId()
+        {
+                return std::to_string(next_result_id.fetch_add(1, std::memory_order_relaxed));
+        }
+
+        UriTable& uris = UriTable::Global();
+        Cache entries;
+        std::atomic<uint64_t> next_result_id{ 1 };
+
+        // Declared last so it is unregistered before |entries| goes away. A
+        // dropped entry only costs the client one full response.
+        std::unique_ptr<MemoryBudget::Consumer> memory = MemoryBudget::Global().Register("semantic_tokens",
+                [this](size_t bytes)
+                {
+                        const size_t held = entries.bytes();
+                        const size_t released = entries.TrimTo(held > bytes ? held - bytes : 0);
+                        memory->Set(entries.bytes());
+                        return released;
+                });
+};
+
+SemanticTokensCache::SemanticTokensCache(size_t max_documents) : d_ptr(new Data(max_documents))
+{
+}
+
+SemanticTokensCache::~SemanticTokensCache()
+{
+        delete d_ptr;
+}
+
+SemanticTokens SemanticTokensCache::Full(const lsDocumentUri& uri, std::vector<SemanticToken> tokens)
+{
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+        entry->result_id = d_ptr->NextResultId();
+        entry->tokens = std::make_shared<const std::vector<SemanticToken>>(std::move(tokens));
+
+        SemanticTokens result;
+        result.resultId = entry->result_id;
+        result.shared_tokens = entry->tokens;
+        d_ptr->Store(d_ptr->uris.Intern(uri), std::move(entry));
+        return result;
+}
+
+SemanticTokensOrDelta SemanticTokensCache::Delta(const lsDocumentUri& uri,
+        const std::string& previous_result_id, std::vector<SemanticToken> tokens)
+{
+        const UriTable::UriId id = d_ptr->uris.Intern(uri);
+        std::shared_ptr<const Entry> previous;
+        SemanticTokensOrDelta result;
+        if (d_ptr->entries.TryGet(id, &previous) && previous->result_id == previous_result_id)
+                result.edits = diffTokens(*previous->tokens, tokens);
+        else
+                result.tokens = SemanticTokens::encodeTokens(tokens);
+
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+        entry->result_id = d_ptr->NextResultId();
+        entry->tokens = std::make_shared<const std::vector<SemanticToken>>(std::move(tokens));
+        result.resultId = entry->result_id;
+        d_ptr->Store(id, std::move(entry));
+        return result;
+}
+
+void SemanticTokensCache::Remove(const lsDocumentUri& uri)
+{
+        const UriTable::UriId id = d_ptr->uris.Find(uri.raw_uri_);
+        std::shared_ptr<const Entry> dropped;
+        if (id != UriTable::kInvalidId && d_ptr->entries.TryTake(id, &dropped))
+                d_ptr->memory->Set(d_ptr->entries.bytes());
+}
+
+void SemanticTokensCache::Clear()
+{
+        d_ptr->entries.Clear();
+        d_ptr->memory->Set(0);
+}
+
+}
@@ -0,0 +1,232 @@
+#include "LibLsp/lsp/UriTable.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "LibLsp/JsonRpc/stringViewVersion.h"
+
+namespace lsp
+{
+namespace
+{
+        // Must be a power of two.
+        constexpr size_t kShardCount = 16;
+
+        struct ViewHash
+        {
+                size_t operator()(const string_view& key) const
+                {
+                        // FNV-1a; URIs of one workspace share long prefixes, so every
+                        // byte has to contribute.
+                        uint64_t hash = 14695981039346656037ull;
+                        for (char c : key)
+                        {
+                                hash ^= static_cast<unsigned char>(c);
+                                hash *= 1099511628211ull;
+                        }
+                        return static_cast<size_t>(hash);
+                }
+        };
+
+        // Hands out dense ids for string keys. Records live in fixed size chunks
+        // that never move, so the index keys are views into the records and
+        // lookups by id take no lock.
+        template <typename Record>
+        class InternPool
+        {
+        public:
+                InternPool() : chunks_(new std::atomic<Record*>[kMaxChunks])
+                {
+                        for (size_t i = 0; i < kMaxChunks; ++i)
+                                chunks_[i].store(nullptr, std::memory_order_relaxed);
+                }
+
+                ~InternPool()
+                {
+                        for (size_t i = 0; i < kMaxChunks; ++i)
+                                delete[] chunks_[i].load(std::memory_order_relaxed);
+                }
+
+                uint32_t Find(string_view key) const
+                {
+                        const size_t hash = ViewHash()(key);
+                        auto& shard = shards_[hash & (kShardCount - 1)];
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        const auto findIt = shard.ids.find(key);
+                        return findIt == shard.ids.end() ? UriTable::kInvalidId : findIt->second;
+                }
+
+                // |make| builds the record of a missing key. It runs without any
+                // lock held, so concurrent callers may both build one; only the
+                // first is kept.
+                template <typename Make, typename KeyOf>
+                uint32_t Intern(string_view key, Make make, KeyOf key_of)
+                {
+                        const uint32_t existing = Find(key);
+                        if (existing != UriTable::kInvalidId)
+                                return existing;
+
+                        Record record = make();
+                        const size_t hash = ViewHash()(key);
+                        auto& shard = shards_[hash & (kShardCount - 1)];
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        const auto findIt = shard.ids.find(key);
+                        if (findIt != shard.ids.end())
+                                return findIt->second;
+
+                        const uint32_t id = next_id_.fetch_add(1, std::memory_order_relaxed);
+                        Record& slot = Slot(id);
+                        slot = std::move(record);
+                        shard.ids.emplace(key_of(slot), id);
+                        return id;
+                }
+
+                const Record& Get(uint32_t id) const
+                {
+                        return chunks_[id >> kChunkBits].load(std::memory_order_acquire)[id & (kChunkSize - 1)];
+                }
+
+                size_t size() const
+                {
+                        return next_id_.load(std::memory_order_relaxed) - 1;
+                }
+
+        private:
+                static constexpr size_t kChunkBits = 12;
+                static constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+                static constexpr size_t kMaxChunks = 4096;
+
+                Record& Slot(uint32_t id)
+                {
+                        const size_t index = id >> kChunkBits;
+                        if (index >= kMaxChunks)
+                                throw std::length_error("UriTable is full");
+                        Record* chunk = chunks_[index].load(std::memory_order_acquire);
+                        if (!chunk)
+                        {
+                                std::lock_guard<std::mutex> lock(grow_mutex_);
+                                chunk = chunks_[index].load(std::memory_order_relaxed);
+                                if (!chunk)
+                                {
+                                        chunk = new Record[kChunkSize];
+                                        chunks_[index].store(chunk, std::memory_order_release);
+                                }
+                        }
+                        return chunk[id & (kChunkSize - 1)];
+                }
+
+                struct Shard
+                {
+                        mutable std::mutex mutex;
+                        std::unordered_map<string_view, uint32_t, ViewHash> ids;
+                };
+                std::array<Shard, kShardCount> shards_;
+                std::unique_ptr<std::atomic<Record*>[]> chunks_;
+                std::mutex grow_mutex_;
+                std::atomic<uint32_t> next_id_{ 1 };
+        };
+
+        struct UriRecord
+        {
+                std::string uri;
+                AbsolutePath path;
+                UriTable::PathId path_id = UriTable::kInvalidId;
+        };
+
+        struct PathRecord
+        {
+                AbsolutePath path;
+        };
+}
+
+struct UriTable::Data
+{
+        InternPool<UriRecord> uris;
+        InternPool<PathRecord> paths;
+};
+
+constexpr uint32_t UriTable::kInvalidId;
+
+UriTable& UriTable::Global()
+{
+        static UriTable* table = new UriTable();
+        return *table;
+}
+
+UriTable::UriTable() : d_ptr(new Data())
+{
+}
+
+UriTable::~UriTable()
+{
+        delete d_ptr;
+}
+
+UriTable::UriId UriTable::Intern(const std::string& raw_uri)
+{
+        return d_ptr->uris.Intern(raw_uri,
+                [&]
+                {
+                        UriRecord record;
+                        record.uri = raw_uri;
+                        lsDocumentUri uri;
+                        uri.raw_uri_ = raw_uri;
+                        record.path = uri.GetAbsolutePath();
+                        record.path_id = InternPath(record.path);
+                        return record;
+                },
+                [](const UriRecord& record) { return string_view(record.uri); });
+}
+
+UriTable::UriId UriTable::Find(const std::string& raw_uri) const
+{
+        return d_ptr->uris.Find(raw_uri);
+}
+
+const std::string& UriTable::Uri(UriId id) const
+{
+        return d_ptr->uris.Get(id).uri;
+}
+
+const AbsolutePath& UriTable::Path(UriId id) const
+{
+        return d_ptr->uris.Get(id).path;
+}
+
+UriTable::PathId UriTable::PathIdOf(UriId id) const
+{
+        return d_ptr->uris.Get(id).path_id;
+}
+
+UriTable::PathId UriTable::InternPath(const AbsolutePath& path)
+{
+        return d_ptr->paths.Intern(path.path,
+                [&] { return PathRecord{ path }; },
+                [](const PathRecord& record) { return string_view(record.path.path); });
+}
+
+UriTable::PathId UriTable::FindPath(const std::string& path) const
+{
+        return d_ptr->paths.Find(path);
+}
+
+const AbsolutePath& UriTable::GetPath(PathId id) const
+{
+        return d_ptr->paths.Get(id).path;
+}
+
+size_t UriTable::UriCount() const
+{
+        return d_ptr->uris.size();
+}
+
+size_t UriTable::PathCount() const
+{
+        return d_ptr->paths.size();
+}
+
+}
@@ -0,0 +1,344 @@
+#include "LibLsp/lsp/WorkspaceScanner.h"
+#include "LibLsp/lsp/GlobSet.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include "LibLsp/lsp/utils.h"
+#endif
+
+namespace lsp
+{
+namespace
+{
+        char ToLowerAscii(char c)
+        {
+                return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+
+        // Case-insensitive suffix compare that does not copy either string.
+        bool EndsWithIgnoreCase(const char* name, size_t name_len, const std::string& suffix)
+        {
+                if (suffix.size() > name_len)
+                        return false;
+                const char* tail = name + name_len - suffix.size();
+                for (size_t i = 0; i < suffix.size(); ++i)
+                {
+                        if (ToLowerAscii(tail[i]) != suffix[i])
+                                return false;
+                }
+                return true;
+        }
+
+        class ParallelWalker
+        {
+        public:
+                ParallelWalker(const std::string& root, const ScanOptions& options, const ScanCallback& callback)
+                        : root_(root), callback_(callback)
+                {
+                        // Keep the separator of "/" and "C:\\", the paths below them
+                        // start right after it.
+                        while (root_.size() > 1 && IsSeparator(root_.back())
+                                && !(root_.size() == 3 && root_[1] == ':'))
+                                root_.pop_back();
+                        relative_offset_ = root_.size() + (IsSeparator(root_.back()) ? 0 : 1);
+                        for (auto suffix : options.suffixes)
+                        {
+                                std::transform(suffix.begin(), suffix.end(), suffix.begin(), ToLowerAscii);
+                                suffixes_.push_back(std::move(suffix));
+                        }
+                        for (auto& glob : options.exclude_globs)
+                        {
+                                if (glob.find('/') != std::string::npos)
+                                        path_globs_.Add(glob);
+                                else
+                                        name_globs_.Add(glob);
+                        }
+                        path_globs_.Build();
+                        name_globs_.Build();
+                        unsigned threads = options.threads;
+                        if (!threads)
+                                threads = std::max(1u, std::thread::hardware_concurrency());
+                        queues_.reset(new Queue[threads]);
+                        thread_count_ = threads;
+                }
+
+                void Run()
+                {
+                        Push(0, root_);
+                        std::vector<std::thread> pool;
+                        for (unsigned i = 1; i < thread_count_; ++i)
+                                pool.emplace_back([this, i] { Work(i); });
+                        Work(0);
+                        for (auto& thread : pool)
+                                thread.join();
+                }
+
+        private:
+                struct Queue
+                {
+                        std::mutex mutex;
+                        std::deque<std::string> dirs;
+                };
+
+                void Push(unsigned self, std::string&& dir)
+                {
+                        pending_.fetch_add(1, std::memory_order_relaxed);
+                        {
+                                std::lock_guard<std::mutex> lock(queues_[self].mutex);
+                                queues_[self].dirs.push_back(std::move(dir));
+                        }
+                        queued_.fetch_add(1, std::memory_order_release);
+                        Wake(false);
+                }
+                void Push(unsigned self, const std::string& dir)
+                {
+                        Push(self, std::string(dir));
+                }
+
+                // Takes the newest directory of our own queue for locality, or steals
+                // the oldest (usually largest remaining subtree) from another worker.
+                bool Pop(unsigned self, std::string& dir)
+                {
+                        {
+                                auto& own = queues_[self];
+                                std::lock_guard<std::mutex> lock(own.mutex);
+                                if (!own.dirs.empty())
+                                {
+                                        dir = std::move(own.dirs.back());
+                                        own.dirs.pop_back();
+                                        queued_.fetch_sub(1, std::memory_order_relaxed);
+                                        return true;
+                                }
+                        }
+                        for (unsigned i = 1; i < thread_count_; ++i)
+                        {
+                                auto& victim = queues_[(self + i) % thread_count_];
+                                std::lock_guard<std::mutex> lock(victim.mutex);
+                                if (!victim.dirs.empty())
+                                {
+                                        dir = std::move(victim.dirs.front());
+                                        victim.dirs.pop_front();
+                                        queued_.fetch_sub(1, std::memory_order_relaxed);
+                                        return true;
+                                }
+                        }
+                        return false;
+                }
+
+                void Work(unsigned self)
+                {
+                        std::string dir;
+                        for (;;)
+                        {
+                                if (Pop(self, dir))
+                                {
+                                        Visit(self, dir);
+                                        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                                                Wake(true);
+                                        continue;
+                                }
+                                // Nothing to steal: sleep until a directory is queued or
+                                // the last one has been visited.
+                                std::unique_lock<std::mutex> lock(idle_mutex_);
+                                idle_cv_.wait(lock, [this] {
+                                        return pending_.load(std::memory_order_acquire) == 0
+                                                || queued_.load(std::memory_order_acquire) > 0;
+                                });
+                                if (pending_.load(std::memory_order_acquire) == 0)
+                                        return;
+                        }
+                }
+
+                // Taking |idle_mutex_| orders the change the caller made before it
+                // with a waiter checking its predicate, so no wakeup is lost.
+                void Wake(bool all)
+                {
+                        std::lock_guard<std::mutex> lock(idle_mutex_);
+                        if (all)
+                                idle_cv_.notify_all();
+                        else
+                                idle_cv_.notify_one();
+                }
+
+                static bool IsSeparator(char c)
+                {
+                        return c == '/' || c == '\\';
+                }
+
+                bool IsExcluded(const std::string& path, const char* name, size_t name_len) const
+                {
+                        if (!name_globs_.empty() && name_globs_.IsMatch(string_view(name, name_len)))
+                                return true;
+                        if (path_globs_.empty() || path.size() <= relative_offset_)
+                                return false;
+                        return path_globs_.IsMatch(string_view(path).substr(relative_offset_));
+                }
+
+                bool WantsFile(const char* name, size_t name_len) const
+                {
+                        if (suffixes_.empty())
+                                return true;
+                        for (auto& suffix : suffixes_)
+                        {
+                                if (EndsWithIgnoreCase(name, name_len, suffix))
+                                        return true;
+                        }
+                        return false;
+                }
+
+                enum class EntryKind { Skip, File, Directory };
+
+                void OnEntry(unsigned self, const std::string& dir, const char* name, size_t name_len, EntryKind kind)
+                {
+                        if (kind == EntryKind::Skip)
+                                return;
+                        if (kind == EntryKind::File && !WantsFile(name, name_len))
+                                return;
+                        std::string path;
+                        path.reserve(dir.size() + 1 + name_len);
+                        path += dir;
+                        if (!IsSeparator(path.back()))
+                                path += '/';
+                        path.append(name, name_len);
+                        if (IsExcluded(path, name, name_len))
+                                return;
+                        if (kind == EntryKind::Directory)
+                                Push(self, std::move(path));
+                        else
+                                callback_(path);
+                }
+
+#ifdef __linux__
+                struct linux_dirent64
+                {
+                        ino64_t d_ino;
+                        off64_t d_off;
+                        unsigned short d_reclen;
+                        unsigned char d_type;
+                        char d_name[1];
+                };
+
+                static EntryKind Classify(int dir_fd, const char* name, unsigned char type)
+                {
+                        struct stat sb;
+                        switch (type)
+                        {
+                        case DT_REG:
+                                return EntryKind::File;
+                        case DT_DIR:
+                                return EntryKind::Directory;
+                        case DT_LNK:
+                                // Report links to files, never follow links to directories.
+                                if (fstatat(dir_fd, name, &sb, 0) == 0 && S_ISREG(sb.st_mode))
+                                        return EntryKind::File;
+                                return EntryKind::Skip;
+                        case DT_UNKNOWN:
+                                if (fstatat(dir_fd, name, &sb, AT_SYMLINK_NOFOLLOW) != 0)
+                                        return EntryKind::Skip;
+                                if (S_ISDIR(sb.st_mode))
+                                        return EntryKind::Directory;
+                                if (S_ISLNK(sb.st_mode))
+                                        return Classify(dir_fd, name, DT_LNK);
+                                return S_ISREG(sb.st_mode) ? EntryKind::File : EntryKind::Skip;
+                        default:
+                                return EntryKind::Skip;
+                        }
+                }
+
+                void Visit(unsigned self, const std::string& dir)
+                {
+                        const int fd = openat(AT_FDCWD, dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                        if (fd < 0)
+                                return;
+                        alignas(linux_dirent64) char buffer[32 * 1024];
+                        for (;;)
+                        {
+                                const long n = syscall(SYS_getdents64, fd, buffer, sizeof buffer);
+                                if (n <= 0)
+                                        break;
+                                for (long offset = 0; offset < n;)
+                                {
+                                        auto* entry = reinterpret_cast<linux_dirent64*>(buffer + offset);
+                                        offset += entry->d_reclen;
+                                        const char* name = entry->d_name;
+                                        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+                                                continue;
+                                        OnEntry(self, dir, name, strlen(name), Classify(fd, name, entry->d_type));
+                                }
+                        }
+                        close(fd);
+                }
+#else
+                void Visit(unsigned self, const std::string& dir)
+                {
+                        namespace fs = boost::filesystem;
+                        boost::system::error_code ec;
+                        fs::directory_iterator it(fs::path(s2ws(dir)), ec), end;
+                        for (; !ec && it != end; it.increment(ec))
+                        {
+                                const std::string name = ws2s(it->path().filename().wstring());
+                                EntryKind kind = EntryKind::Skip;
+                                const auto link_status = it->symlink_status(ec);
+                                if (ec)
+                                        continue;
+                                if (fs::is_symlink(link_status))
+                                {
+                                        if (fs::is_regular_file(it->status(ec)))
+                                                kind = EntryKind::File;
+                                }
+                                else if (fs::is_directory(link_status))
+                                {
+                                        kind = EntryKind::Directory;
+                                }
+                                else if (fs::is_regular_file(link_status))
+                                {
+                                        kind = EntryKind::File;
+                                }
+                                ec.clear();
+                                OnEntry(self, dir, name.c_str(), name.size(), kind);
+                        }
+                }
+#endif
+
+                std::string root_;
+                size_t relative_offset_ = 0;
+                const ScanCallback& callback_;
+                std::vector<std::string> suffixes_;
+                GlobSet name_globs_;
+                GlobSet path_globs_;
+                std::unique_ptr<Queue[]> queues_;
+                unsigned thread_count_ = 1;
+                // Directories queued or being visited. Zero means the walk is done.
+                std::atomic<size_t> pending_{ 0 };
+                // Directories queued and not yet taken by a worker.
+                std::atomic<size_t> queued_{ 0 };
+                std::mutex idle_mutex_;
+                std::condition_variable idle_cv_;
+        };
+}
+
+void ScanWorkspace(const std::string& root, const ScanOptions& options, const ScanCallback& callback)
+{
+        if (root.empty())
+                return;
+        ParallelWalker walker(root, options, callback);
+        walker.Run();
+}
+
+}
@@ -34,7 +34,7 @@ void Reflect(Writer& writer, lsInitializeParams::lsTrace& value)
 }
  void Reflect(Reader& visitor, std::pair<optional<lsTextDocumentSyncKind>, optional<lsTextDocumentSyncOptions> >& value)
 {
-        if(((JsonReader&)visitor).m_->IsObject())
+        if(visitor.IsObject())
         {
                 Reflect(visitor, value.second);
         }
@@ -7,6 +7,7 @@
 
 
 #include <stdio.h>
+#include <mutex>
 #include <iostream>
 #include "LibLsp/lsp/location_type.h"
 #include "LibLsp/lsp/out_list.h"
@@ -142,7 +143,8 @@ void Reflect(Reader& visitor, lsMarkedString& value)
 {
           if(!visitor.IsArray())
           {
-                  throw std::invalid_argument("Rsp_LocationListEither::Either& value is not array");
+                  visitor.Fail("Rsp_LocationListEither::Either& value is not array");
+                  return;
           }
           auto data = ((JsonReader&)visitor).m_->GetArray();
           if (data.Size() && data[0].HasMember("originSelectionRange"))
@@ -211,18 +213,71 @@ void Reflect(Reader& visitor, lsWorkspaceEdit::Either& value)
                 Reflect(visitor, value.second);
         }
 }
+namespace lsp
+{
+        struct Any::Dom
+        {
+                // The serialized document, built the first time it is asked
+                // for. Copies of an Any read it from any thread.
+                const std::string& Text() const
+                {
+                        std::call_once(text_once, [this]
+                                {
+                                        rapidjson::StringBuffer output;
+                                        rapidjson::Writer<rapidjson::StringBuffer> writer(output);
+                                        document.Accept(writer);
+                                        text.assign(output.GetString(), output.GetSize());
+                                });
+                        return text;
+                }
+
+                rapidjson::Document document;
+
+        private:
+                mutable std::once_flag text_once;
+                mutable std::string text;
+        };
+
+        struct AnyAccess
+        {
+                static const rapidjson::Value* Value(Any& any)
+                {
+                        if (!any.Materialize())
+                                return nullptr;
+                        return &any.dom->document;
+                }
+
+                // Only the DOM that is already there; never parses.
+                static const rapidjson::Value* Parsed(const Any& any)
+                {
+                        return any.dom ? &any.dom->document : nullptr;
+                }
+
+                static void CopyFrom(Any& any, const rapidjson::Value& source)
+                {
+                        auto dom = std::make_shared<Any::Dom>();
+                        // Copies unowned strings too: after an in-situ parse
+                        // they point into the message buffer.
+                        dom->document.CopyFrom(source, dom->document.GetAllocator(), true);
+                        any.jsonType = source.GetType();
+                        any.data.clear();
+                        any.dom = std::move(dom);
+                }
+        };
+}
+
 ResourceOperation* GetResourceOperation(lsp::Any& lspAny)
 {
-        rapidjson::Document document;
-        auto& data = lspAny.Data();
-        document.Parse(data.c_str(), data.length());
-        if (document.HasParseError()) {
-                // ��ʾ
+        auto value = const_cast<rapidjson::Value*>(lsp::AnyAccess::Value(lspAny));
+        if (!value || !value->IsObject()) {
+                return nullptr;
+        }
+        auto find = value->FindMember("kind");
+        if (find == value->MemberEnd()) {
                 return nullptr;
         }
-        auto find = document.FindMember("kind");
 
-        JsonReader visitor{ &document };
+        JsonReader visitor{ value };
         try
         {
                 if (find->value == "create")
@@ -330,29 +385,49 @@ int lsp::Any::GetType()
 {
         if (jsonType == Type::kUnKnown)
         {
-                if (data.empty())
+                if (data.empty() && !dom)
                 {
                         jsonType = rapidjson::kNullType;
                         return jsonType;
                 }
-                rapidjson::Document document;
-                document.Parse(data.c_str(), data.length());
-                if (document.HasParseError())
-                {
-                        // ��ʾ
-                        return jsonType;
-                }
-                jsonType = document.GetType();
+                // The parse is kept, so learning the type costs nothing later.
+                Materialize();
         }
         return jsonType;
 }
 
+bool lsp::Any::Materialize()
+{
+        if (dom)
+                return true;
+        auto parsed = std::make_shared<Dom>();
+        parsed->document.Parse(data.c_str(), data.length());
+        if (parsed->document.HasParseError())
+        {
+                return false;
+        }
+        if (jsonType == kUnKnown)
+        {
+                jsonType = parsed->document.GetType();
+        }
+        dom = std::move(parsed);
+        return true;
+}
+
+const std::string& lsp::Any::Data() const
+{
+        if (data.empty() && dom)
+                return dom->Text();
+        return data;
+}
+
 void lsp::Any::Set(std::unique_ptr<LspMessage> value)
 {
         if (value)
         {
                 jsonType = rapidjson::Type::kObjectType;
                 data = value->ToJson();
+                dom.reset();
         }
         else
         {
@@ -364,6 +439,7 @@ void lsp::Any::SetJsonString(std::string&& _data, Type _type)
 {
         jsonType = _type;
         data.swap(_data);
+        dom.reset();
         GetType();
 }
 
@@ -371,27 +447,19 @@ void lsp::Any::SetJsonString(const std::string& _data, Type _type)
 {
         jsonType = _type;
         data = (_data);
+        dom.reset();
         GetType();
 }
 
 void lsp::Any::swap(Any& arg) noexcept
 {
         data.swap(arg.data);
+        dom.swap(arg.dom);
         const int temp = jsonType;
         jsonType = arg.jsonType;
         arg.jsonType = temp;
 }
 
-class JsonReaderForAny : public  JsonReader
-{
-public:
-        JsonReaderForAny()
-                : JsonReader(&document)
-        {
-        }
-        rapidjson::Document document;
-};
-
 bool lsp::Any::GetForMapHelper(std::string& value)
 {
         return Get(value);
@@ -402,20 +470,25 @@ bool lsp::Any::GetForMapHelper(optional<std::string>& value)
         return Get(value);
 }
 
+void lsp::Any::GetForMapHelper(Reader& visitor, std::string& value)
+{
+        Reflect(visitor, value);
+}
+
+void lsp::Any::GetForMapHelper(Reader& visitor, optional<std::string>& value)
+{
+        Reflect(visitor, value);
+}
+
 std::unique_ptr<Reader> lsp::Any::GetReader()
 {
-        auto reader = new JsonReaderForAny();
-        std::unique_ptr<Reader> ret(reader);
-        reader->document.Parse(data.c_str(), data.length());
-        if (reader->document.HasParseError())
+        if (!Materialize())
         {
                 return {};
         }
-        if (jsonType == kUnKnown)
-        {
-                jsonType = reader->document.GetType();
-        }
-        return (ret);
+        // Readers never modify the value they walk.
+        auto value = const_cast<rapidjson::Document*>(&dom->document);
+        return std::unique_ptr<Reader>(new JsonReader(value));
 }
 
 class JsonWriterForAny : public JsonWriter
@@ -438,76 +511,24 @@ void lsp::Any::SetData(std::unique_ptr<Writer>& writer)
 {
         auto _temp = static_cast<JsonWriterForAny*>(writer.get());
         data = _temp->output.GetString();
+        dom.reset();
         GuessType();
 }
 
-namespace
-{
-#if 0
-        rapidjson::Type convert(lsp::Any::Type type)
-        {
-                switch (type)
-                {
-                case lsp::Any::Type::kNullType:
-                        return rapidjson::Type::kNullType;
-                case lsp::Any::Type::kFalseType:
-                        return rapidjson::Type::kFalseType;
-                case lsp::Any::Type::kTrueType:
-                        return rapidjson::Type::kTrueType;
-                case lsp::Any::Type::kObjectType:
-                        return rapidjson::Type::kObjectType;
-                case lsp::Any::Type::kArrayType:
-                        return rapidjson::Type::kArrayType;
-                case lsp::Any::Type::kStringType:
-                        return rapidjson::Type::kStringType;
-                case lsp::Any::Type::kNumberType:
-                        return rapidjson::Type::kNumberType;
-                default:
-                        return rapidjson::Type::kNullType;
-                }
-        }
-#endif
-        lsp::Any::Type convert(rapidjson::Type type)
-        {
-                switch (type)
-                {
-                case rapidjson::Type::kNullType:
-                        return lsp::Any::Type::kNullType;
-                case rapidjson::Type::kFalseType:
-                        return lsp::Any::Type::kFalseType;
-                case rapidjson::Type::kTrueType:
-                        return lsp::Any::Type::kTrueType;
-                case rapidjson::Type::kObjectType:
-                        return lsp::Any::Type::kObjectType;
-                case rapidjson::Type::kArrayType:
-                        return lsp::Any::Type::kArrayType;
-                case rapidjson::Type::kStringType:
-                        return lsp::Any::Type::kStringType;
-                case rapidjson::Type::kNumberType:
-                        return lsp::Any::Type::kNumberType;
-                default:
-                        return lsp::Any::Type::kNullType;
-                }
-        }
-}
-
 void Reflect(Reader& visitor, lsp::Any& value)
 {
-
-         //if (visitor.IsNull()) {
-                // visitor.GetNull();
-                // value.SetJsonString("", rapidjson::Type::kNullType);
-                // return;
-         //}else
-         //{
-                //
-         //}
+         // Copy the subtree once instead of printing it and parsing it back.
          JsonReader& json_reader = reinterpret_cast<JsonReader&>(visitor);
-         value.SetJsonString(visitor.ToString(), convert(json_reader.m_->GetType()));
+         lsp::AnyAccess::CopyFrom(value, *json_reader.m_);
 }
  void Reflect(Writer& visitor, lsp::Any& value)
  {
          JsonWriter& json_writer = reinterpret_cast<JsonWriter&>(visitor);
+         if (auto dom = lsp::AnyAccess::Parsed(value))
+         {
+                 dom->Accept(*json_writer.m_);
+                 return;
+         }
          json_writer.m_->RawValue( value.Data().data(),value.Data().size(),static_cast<rapidjson::Type>(value.GetType()));
 
  }
@@ -636,7 +657,8 @@ bool AbsolutePath::operator>(const AbsolutePath& rhs) const
 }
 
 void Reflect(Reader& visitor, AbsolutePath& value) {
-        value.path = visitor.GetString();
+        const string_view path = visitor.GetStringView();
+        value.path.assign(path.data(), path.size());
 }
 void Reflect(Writer& visitor, AbsolutePath& value) {
         visitor.String(value.path.c_str(), value.path.length());
@@ -748,22 +770,31 @@ bool lsDocumentUri::operator==(const std::string& other) const
 }
 
 
-AbsolutePath lsDocumentUri::GetAbsolutePath() const {
-
-
-                if (raw_uri_.find("file://") != std::string::npos){
+namespace
+{
+        AbsolutePath NormalizeUri(const lsDocumentUri& uri)
+        {
+                if (uri.raw_uri_.find("file://") != std::string::npos) {
                         try
                         {
-                                return lsp::NormalizePath(GetRawPath(), false /*ensure_exists*/, false);
+                                return lsp::NormalizePath(uri.GetRawPath(), false /*ensure_exists*/, false);
                         }
                         catch (std::exception&)
                         {
                                 return AbsolutePath("", false);
                         }
                 }
+                return AbsolutePath(uri.raw_uri_, false);
+        }
+}
 
-                return AbsolutePath(raw_uri_,false);
-
+AbsolutePath lsDocumentUri::GetAbsolutePath() const {
+        // Called for every notification about a document, mostly with the same
+        // few URIs. Normalizing without |ensure_exists| never looks at the file
+        // system, so an entry stays valid until it is evicted.
+        static ConcurrentLruCache<std::string, AbsolutePath>* cache =
+                new ConcurrentLruCache<std::string, AbsolutePath>(4096);
+        return cache->Get(raw_uri_, [this] { return NormalizeUri(*this); });
 }
 
 AbsolutePath::AbsolutePath(const std::string& path, bool validate)
@@ -8,6 +8,8 @@
 #include "LibLsp/lsp/textDocument/semanticHighlighting.h"
 #include "LibLsp/lsp/textDocument/SemanticTokens.h"
 #include "LibLsp/JsonRpc/json.h"
+#include <algorithm>
+#include <climits>
 
 
 constexpr unsigned SemanticTokenEncodingSize = 5;
@@ -206,6 +208,195 @@ std::vector<int32_t> SemanticTokens::encodeTokens(std::vector<SemanticToken>& to
         return result;
 }
 
+static_assert(sizeof(SemanticToken) == SemanticTokenEncodingSize * sizeof(int32_t),
+        "SemanticToken must be laid out like its five encoded integers");
+
+void ReflectSemanticTokens(Writer& visitor, const std::vector<SemanticToken>& tokens)
+{
+        // The fields are unsigned ints in encoding order, so the vector already
+        // is the encoded array.
+        visitor.IntArray(reinterpret_cast<const int32_t*>(tokens.data()),
+                SemanticTokenEncodingSize * tokens.size());
+}
+
+void Reflect(Writer& visitor, SemanticTokens& value)
+{
+        REFLECT_MEMBER_START();
+        visitor.Key("data");
+        if (value.data.empty() && value.tokens.empty() && value.shared_tokens)
+                ReflectSemanticTokens(visitor, *value.shared_tokens);
+        else if (value.data.empty())
+                ReflectSemanticTokens(visitor, value.tokens);
+        else
+                Reflect(visitor, value.data);
+        REFLECT_MEMBER(resultId);
+        REFLECT_MEMBER_END();
+}
+
+void Reflect(Reader& visitor, SemanticTokensEdit& value)
+{
+        unsigned start = 0;
+        unsigned deleteCount = 0;
+        REFLECT_MEMBER_START();
+        REFLECT_MEMBER2("start", start);
+        REFLECT_MEMBER2("deleteCount", deleteCount);
+        REFLECT_MEMBER2("data", value.tokens);
+        REFLECT_MEMBER_END();
+        value.startToken = start / SemanticTokenEncodingSize;
+        value.deleteTokens = deleteCount / SemanticTokenEncodingSize;
+}
+
+void Reflect(Writer& visitor, SemanticTokensEdit& value)
+{
+        unsigned start = value.startToken * SemanticTokenEncodingSize;
+        unsigned deleteCount = value.deleteTokens * SemanticTokenEncodingSize;
+        REFLECT_MEMBER_START();
+        REFLECT_MEMBER2("start", start);
+        REFLECT_MEMBER2("deleteCount", deleteCount);
+        REFLECT_MEMBER2("data", value.tokens);
+        REFLECT_MEMBER_END();
+}
+
+namespace
+{
+        // Past this many inserted plus deleted tokens the changed region is
+        // replaced as a whole.
+        constexpr int kMaxDiffDistance = 64;
+        // Unchanged runs shorter than this are folded into the edits around
+        // them; an extra edit costs more bytes than resending a few tokens.
+        constexpr size_t kMinUnchangedRun = 3;
+
+        struct Run
+        {
+                size_t old_begin;
+                size_t new_begin;
+                size_t length;
+        };
+
+        // Myers' O(ND) diff of a[0, n) against b[0, m). Returns the matching
+        // runs in order, or false if the edit distance exceeds |max_distance|.
+        bool MatchingRuns(const SemanticToken* a, int n, const SemanticToken* b, int m,
+                int max_distance, std::vector<Run>& runs)
+        {
+                max_distance = std::min(max_distance, n + m);
+                const int offset = max_distance + 1;
+                std::vector<int> furthest(2 * max_distance + 3, 0);
+                // Frontier before each round, for walking the path back.
+                std::vector<std::vector<int>> trace;
+                int distance = -1;
+                for (int d = 0; d <= max_distance && distance < 0; ++d)
+                {
+                        trace.push_back(furthest);
+                        for (int k = -d; k <= d; k += 2)
+                        {
+                                int x;
+                                if (k == -d || (k != d && furthest[offset + k - 1] < furthest[offset + k + 1]))
+                                        x = furthest[offset + k + 1];
+                                else
+                                        x = furthest[offset + k - 1] + 1;
+                                int y = x - k;
+                                while (x < n && y < m && a[x] == b[y])
+                                {
+                                        ++x;
+                                        ++y;
+                                }
+                                furthest[offset + k] = x;
+                                if (x >= n && y >= m)
+                                {
+                                        distance = d;
+                                        break;
+                                }
+                        }
+                }
+                if (distance < 0)
+                        return false;
+
+                int x = n;
+                int y = m;
+                for (int d = distance; d > 0; --d)
+                {
+                        const std::vector<int>& previous = trace[d];
+                        const int k = x - y;
+                        const bool inserted = k == -d
+                                || (k != d && previous[offset + k - 1] < previous[offset + k + 1]);
+                        const int previous_x = previous[offset + (inserted ? k + 1 : k - 1)];
+                        const int previous_y = previous_x - (inserted ? k + 1 : k - 1);
+                        const int snake_x = inserted ? previous_x : previous_x + 1;
+                        const int snake_y = inserted ? previous_y + 1 : previous_y;
+                        if (x > snake_x)
+                                runs.push_back(Run{ size_t(snake_x), size_t(snake_y), size_t(x - snake_x) });
+                        x = previous_x;
+                        y = previous_y;
+                }
+                if (x > 0)
+                        runs.push_back(Run{ 0, 0, size_t(x) });
+                std::reverse(runs.begin(), runs.end());
+                return true;
+        }
+
+        SemanticTokensEdit MakeEdit(size_t old_begin, size_t old_end,
+                const SemanticToken* inserted, size_t inserted_count)
+        {
+                SemanticTokensEdit edit;
+                edit.startToken = static_cast<unsigned>(old_begin);
+                edit.deleteTokens = static_cast<unsigned>(old_end - old_begin);
+                const int32_t* encoded = reinterpret_cast<const int32_t*>(inserted);
+                edit.tokens.assign(encoded, encoded + SemanticTokenEncodingSize * inserted_count);
+                return edit;
+        }
+}
+
+std::vector<SemanticTokensEdit> diffTokens(const std::vector<SemanticToken>& old_tokens,
+        const std::vector<SemanticToken>& new_tokens)
+{
+        std::vector<SemanticTokensEdit> edits;
+        size_t prefix = 0;
+        const size_t common = std::min(old_tokens.size(), new_tokens.size());
+        while (prefix < common && old_tokens[prefix] == new_tokens[prefix])
+                ++prefix;
+        size_t suffix = 0;
+        while (suffix < common - prefix
+                && old_tokens[old_tokens.size() - 1 - suffix] == new_tokens[new_tokens.size() - 1 - suffix])
+                ++suffix;
+
+        const size_t old_count = old_tokens.size() - prefix - suffix;
+        const size_t new_count = new_tokens.size() - prefix - suffix;
+        if (!old_count && !new_count)
+                return edits;
+        const SemanticToken* old_middle = old_tokens.data() + prefix;
+        const SemanticToken* new_middle = new_tokens.data() + prefix;
+
+        std::vector<Run> runs;
+        if (old_count && new_count && old_count + new_count < size_t(INT_MAX)
+                && MatchingRuns(old_middle, static_cast<int>(old_count), new_middle,
+                        static_cast<int>(new_count), kMaxDiffDistance, runs))
+        {
+                size_t old_at = 0;
+                size_t new_at = 0;
+                for (const Run& run : runs)
+                {
+                        if (run.length < kMinUnchangedRun)
+                                continue;
+                        if (run.old_begin > old_at || run.new_begin > new_at)
+                        {
+                                edits.push_back(MakeEdit(prefix + old_at, prefix + run.old_begin,
+                                        new_middle + new_at, run.new_begin - new_at));
+                        }
+                        old_at = run.old_begin + run.length;
+                        new_at = run.new_begin + run.length;
+                }
+                if (old_at < old_count || new_at < new_count)
+                {
+                        edits.push_back(MakeEdit(prefix + old_at, prefix + old_count,
+                                new_middle + new_at, new_count - new_at));
+                }
+                return edits;
+        }
+
+        edits.push_back(MakeEdit(prefix, prefix + old_count, new_middle, new_count));
+        return edits;
+}
+
 void Reflect(Reader& visitor, TextDocumentComplete::Either& value)
 {
         if(visitor.IsArray())
@@ -257,12 +448,11 @@ void Reflect(Reader& visitor, std::pair<optional<std::string>, optional<MarkupCo
 }
   void Reflect(Reader& visitor, TextDocumentHover::Either& value)
 {
-          JsonReader& reader = dynamic_cast<JsonReader&>(visitor);
-          if (reader.IsArray())
+          if (visitor.IsArray())
           {
                   Reflect(visitor, value.first);
           }
-          else if(reader.m_->IsObject())
+          else if(visitor.IsObject())
           {
                   Reflect(visitor, value.second);
           }
@@ -12,11 +12,20 @@
 #include <string>
 #include <unordered_map>
 #include <sys/stat.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include "LibLsp/lsp/lsPosition.h"
+#include "LibLsp/lsp/WorkspaceScanner.h"
 #include "utf8.h"
 #ifdef  _WIN32
 #include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 
@@ -158,62 +167,238 @@ std::string EscapeFileName(std::string path) {
   return path;
 }
 
-// http://stackoverflow.com/a/6089413
-std::istream& SafeGetline(std::istream& is, std::string& t) {
-  t.clear();
+bool FileExists(const std::string& filename) {
+  std::ifstream cache(filename);
+  return cache.is_open();
+}
 
-  // The characters in the stream are read one-by-one using a std::streambuf.
-  // That is faster than reading them one-by-one using the std::istream. Code
-  // that uses streambuf this way must be guarded by a sentry object. The sentry
-  // object performs various tasks, such as thread synchronization and updating
-  // the stream state.
+#ifdef _WIN32
+optional<std::string> ReadContent(const AbsolutePath& filename) {
+  // Text mode, as before: CRLF comes back as LF, so the size from tellg is an
+  // upper bound rather than the length read.
+  std::ifstream cache(filename.path, std::ios::in);
+  if (!cache.is_open())
+    return {};
+  cache.seekg(0, std::ios::end);
+  const auto size = cache.tellg();
+  cache.seekg(0, std::ios::beg);
+
+  std::string content;
+  if (size > 0) {
+    content.resize(static_cast<size_t>(size));
+    cache.read(&content[0], size);
+    content.resize(static_cast<size_t>(cache.gcount()));
+  }
+  // The size is only a hint; pick up anything appended since.
+  char buffer[4096];
+  while (cache.read(buffer, sizeof buffer) || cache.gcount())
+    content.append(buffer, static_cast<size_t>(cache.gcount()));
+  return content;
+}
+#else
+optional<std::string> ReadContent(const AbsolutePath& filename) {
+  const int fd = ::open(filename.path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return {};
 
-  std::istream::sentry se(is, true);
-  std::streambuf* sb = is.rdbuf();
+  struct stat sb;
+  size_t capacity = 0;
+  if (::fstat(fd, &sb) == 0 && sb.st_size > 0)
+    capacity = static_cast<size_t>(sb.st_size);
 
+  // Size the string from fstat and fill it with pread; the file may still
+  // grow or shrink underneath us, so keep going until read returns 0.
+  std::string content;
+  content.resize(capacity ? capacity : 4096);
+  size_t offset = 0;
   for (;;) {
-    int c = sb->sbumpc();
-    if (c == EOF) {
-      // Also handle the case when the last line has no line ending
-      if (t.empty())
-        is.setstate(std::ios::eofbit);
-      return is;
+    if (offset == content.size())
+      content.resize(content.size() * 2);
+    const ssize_t n = ::pread(fd, &content[offset], content.size() - offset,
+                              static_cast<off_t>(offset));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      ::close(fd);
+      return {};
     }
+    if (n == 0)
+      break;
+    offset += static_cast<size_t>(n);
+  }
+  ::close(fd);
+  content.resize(offset);
+  return content;
+}
+#endif
 
-    t += (char)c;
+std::vector<std::string> ReadLinesWithEnding(const AbsolutePath& filename) {
+  std::vector<std::string> result;
 
-    if (c == '\n')
-      return is;
+  // Read, not mapped: the file may be truncated while we look at it.
+  const optional<std::string> content = ReadContent(filename);
+  if (!content)
+    return result;
+
+  const char* it = content->data();
+  const char* end = it + content->size();
+  while (it != end) {
+    const char* newline = static_cast<const char*>(memchr(it, '\n', end - it));
+    const char* line_end = newline ? newline + 1 : end;
+    result.emplace_back(it, line_end);
+    it = line_end;
   }
+
+  return result;
 }
 
-bool FileExists(const std::string& filename) {
-  std::ifstream cache(filename);
-  return cache.is_open();
+std::vector<optional<std::string>> ReadContents(const std::vector<AbsolutePath>& filenames,
+                                                unsigned threads) {
+  std::vector<optional<std::string>> result(filenames.size());
+  if (!threads)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::min<size_t>(threads, filenames.size()));
+
+  std::atomic<size_t> next{0};
+  auto worker = [&] {
+    for (size_t i = next.fetch_add(1); i < filenames.size(); i = next.fetch_add(1))
+      result[i] = ReadContent(filenames[i]);
+  };
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i)
+    pool.emplace_back(worker);
+  worker();
+  for (auto& thread : pool)
+    thread.join();
+  return result;
 }
 
-optional<std::string> ReadContent(const AbsolutePath& filename) {
+MappedFile::~MappedFile() {
+  Close();
+}
 
-  std::ifstream cache;
-  cache.open(filename.path);
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+  *this = std::move(other);
+}
 
-  try {
-    return std::string(std::istreambuf_iterator<char>(cache),
-                       std::istreambuf_iterator<char>());
-  } catch (std::ios_base::failure&) {
-    return {};
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    Close();
+    data_ = other.data_;
+    size_ = other.size_;
+    open_ = other.open_;
+    mapped_ = other.mapped_;
+    owned_ = std::move(other.owned_);
+    if (open_ && !mapped_)
+      data_ = owned_.data();
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.open_ = false;
+    other.mapped_ = false;
   }
+  return *this;
 }
 
-std::vector<std::string> ReadLinesWithEnding(const AbsolutePath& filename) {
-  std::vector<std::string> result;
+namespace {
+// For files that report no size, which may still have content.
+bool ReadInto(const AbsolutePath& filename, std::string& owned) {
+  optional<std::string> content = ReadContent(filename);
+  if (!content)
+    return false;
+  owned = std::move(*content);
+  return true;
+}
+}  // namespace
+
+#ifdef _WIN32
+bool MappedFile::Open(const AbsolutePath& filename) {
+  Close();
+  HANDLE file = CreateFileW(s2ws(filename.path).c_str(), GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return false;
+  }
+  if (size.QuadPart == 0) {
+    CloseHandle(file);
+    if (!ReadInto(filename, owned_))
+      return false;
+    data_ = owned_.data();
+    size_ = owned_.size();
+    open_ = true;
+    return true;
+  }
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping)
+    return false;
+  // The view keeps the mapping alive after the handles are closed.
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!view)
+    return false;
+  data_ = static_cast<const char*>(view);
+  size_ = static_cast<size_t>(size.QuadPart);
+  open_ = true;
+  mapped_ = true;
+  return true;
+}
 
-  std::ifstream input(filename.path);
-  for (std::string line; SafeGetline(input, line);)
-    result.emplace_back(line);
+void MappedFile::Close() {
+  if (mapped_)
+    UnmapViewOfFile(data_);
+  data_ = nullptr;
+  size_ = 0;
+  open_ = false;
+  mapped_ = false;
+  owned_.clear();
+}
+#else
+bool MappedFile::Open(const AbsolutePath& filename) {
+  Close();
+  const int fd = ::open(filename.path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat sb;
+  if (::fstat(fd, &sb) != 0) {
+    ::close(fd);
+    return false;
+  }
+  if (sb.st_size == 0) {
+    ::close(fd);
+    if (!ReadInto(filename, owned_))
+      return false;
+    data_ = owned_.data();
+    size_ = owned_.size();
+    open_ = true;
+    return true;
+  }
+  void* view = ::mmap(nullptr, static_cast<size_t>(sb.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (view == MAP_FAILED)
+    return false;
+  ::madvise(view, static_cast<size_t>(sb.st_size), MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(view);
+  size_ = static_cast<size_t>(sb.st_size);
+  open_ = true;
+  mapped_ = true;
+  return true;
+}
 
-  return result;
+void MappedFile::Close() {
+  if (mapped_)
+    ::munmap(const_cast<char*>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+  open_ = false;
+  mapped_ = false;
+  owned_.clear();
 }
+#endif
 
 bool WriteToFile(const std::string& filename, const std::string& content) {
   std::ofstream file(filename,
@@ -371,9 +556,13 @@ AbsolutePath RealPathNotExpandSymlink(std::string path,
                 // Here we differ from realpath(3), we use stat(2) instead of
                 // lstat(2) because we do not want to resolve symlinks.
                 resolved += next_token;
-                if (stat(resolved.c_str(), &sb) != 0 && ensure_exists)
+                // Without |ensure_exists| the result does not depend on the file
+                // system, so skip the per-component stat(2).
+                if (!ensure_exists)
+                        continue;
+                if (stat(resolved.c_str(), &sb) != 0)
                         return {};
-                if (!S_ISDIR(sb.st_mode) && j < path.size() && ensure_exists) {
+                if (!S_ISDIR(sb.st_mode) && j < path.size()) {
                         errno = ENOTDIR;
                         return {};
                 }
@@ -539,37 +728,11 @@ void scanFilesUseRecursive(
         const std::wstring& rootPath,
         std::vector<std::wstring>& ret,
         std::wstring suf) {
-        namespace fs = boost::filesystem;
-        boost::to_lower(suf);
-
-        fs::path fullpath(rootPath);
-        if (!fs::exists(fullpath)) { return; }
-        fs::recursive_directory_iterator end_iter;
-        for (fs::recursive_directory_iterator iter(fullpath); iter != end_iter; iter++) {
-                try {
-                        if (!fs::is_directory(*iter) && fs::is_regular_file(*iter)) {
-                                auto temp_path = iter->path().wstring();
-                                auto size = suf.size();
-                                if (!size)
-                                {
-                                        ret.push_back(std::move(temp_path));
-                                }
-                                else
-                                {
-
-                                        if (temp_path.size() < size) continue;
-                                        auto suf_temp = temp_path.substr(temp_path.size() - size);
-                                        boost::to_lower(suf_temp);
-                                        if (suf_temp == suf)
-                                        {
-                                                ret.push_back(std::move(temp_path));
-                                        }
-                                }
-                        }
-                }
-                catch (const std::exception&) {
-                        continue;
-                }
+        std::vector<std::string> out;
+        scanFilesUseRecursive(ws2s(rootPath), out, ws2s(suf));
+        for (auto& it : out)
+        {
+                ret.push_back(s2ws(it));
         }
 }
 
@@ -590,22 +753,35 @@ void scanFileNamesUseRecursive(const std::wstring& rootPath, std::vector<std::ws
 
 void scanFileNamesUseRecursive(const std::string& rootPath, std::vector<std::string>& ret, std::string strSuf)
 {
-        std::vector<std::wstring> out;
-        scanFileNamesUseRecursive(s2ws(rootPath), out, s2ws(strSuf));
+        std::vector<std::string> out;
+        scanFilesUseRecursive(rootPath, out, strSuf);
         for (auto& it : out)
         {
-                ret.push_back(ws2s(it));
+                if (it.size() >= rootPath.size())
+                {
+                        ret.push_back(it.substr(rootPath.size()));
+                }
         }
 }
 
 void scanFilesUseRecursive(const std::string& rootPath, std::vector<std::string>& ret, std::string strSuf)
 {
-        std::vector<std::wstring> out;
-        scanFilesUseRecursive(s2ws(rootPath), out, s2ws(strSuf));
-        for (auto& it : out)
+        ScanOptions options;
+        if (!strSuf.empty())
+                options.suffixes.push_back(std::move(strSuf));
+        // Callers block on this from request handlers; a walk is mostly I/O
+        // bound, so a few threads get most of the speedup without taking
+        // every core away from the rest of the server.
+        options.threads = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+        std::mutex mutex;
+        const size_t first = ret.size();
+        ScanWorkspace(rootPath, options, [&](const std::string& path)
         {
-                ret.push_back(ws2s(it));
-        }
+                std::lock_guard<std::mutex> lock(mutex);
+                ret.push_back(path);
+        });
+        // Walker threads finish in any order; keep the result stable.
+        std::sort(ret.begin() + first, ret.end());
 }
 
 
@@ -4,12 +4,86 @@
 #include <numeric>
 #include "LibLsp/lsp/utils.h"
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <array>
 #include "LibLsp/lsp/AbsolutePath.h"
+#include "LibLsp/lsp/UriTable.h"
+#include "LibLsp/JsonRpc/MemoryBudget.h"
 using namespace lsp;
+
+namespace
+{
+    // Must be a power of two.
+    constexpr size_t kShardCount = 16;
+
+    size_t ShardOf(size_t hash)
+    {
+        return hash & (kShardCount - 1);
+    }
+}
+
 struct WorkingFilesData
 {
-    std::map<AbsolutePath, std::shared_ptr<WorkingFile> > files;
-    std::mutex files_mutex;  // Protects |d_ptr->files|.
+    struct Shard
+    {
+        std::mutex mutex;  // Protects |files| and the content of every file in it.
+        std::unordered_map<uint32_t, std::shared_ptr<WorkingFile> > files;
+    };
+
+    Shard& ShardFor(uint32_t id)
+    {
+        return shards[ShardOf(id)];
+    }
+
+    // Secondary index used by CloseFilesInDirectory. Lock order is always
+    // Shard::mutex first, then |directories_mutex|.
+    void AddToDirectory(const WorkingFile& file)
+    {
+        std::lock_guard<std::mutex> lock(directories_mutex);
+        directories[file.directory.path].insert(file.path_id);
+    }
+    void RemoveFromDirectory(const WorkingFile& file)
+    {
+        std::lock_guard<std::mutex> lock(directories_mutex);
+        const auto findIt = directories.find(file.directory.path);
+        if (findIt == directories.end())
+            return;
+        findIt->second.erase(file.path_id);
+        if (findIt->second.empty())
+            directories.erase(findIt);
+    }
+
+    // Documents are keyed by the PathId of their URI, so repeated
+    // notifications for the same URI never normalize it again.
+    lsp::UriTable& uris = lsp::UriTable::Global();
+
+    // PathId of an open document, without interning |uri|: only OnOpen may
+    // add entries, or every stray notification would grow the table for
+    // good. A URI spelled differently from the one that opened the file is
+    // found by its path. Returns kInvalidId if the document was never opened.
+    uint32_t FindOpen(const lsDocumentUri& uri) const
+    {
+        const auto uri_id = uris.Find(uri.raw_uri_);
+        if (uri_id != lsp::UriTable::kInvalidId)
+            return uris.PathIdOf(uri_id);
+        return uris.FindPath(uri.GetAbsolutePath().path);
+    }
+    std::array<Shard, kShardCount> shards;
+
+    std::mutex directories_mutex;
+    std::unordered_map<std::string, std::unordered_set<uint32_t> > directories;
+
+    lsp::AsyncFileWriter writer;
+
+    // Bytes held in document buffers. Open documents belong to the client,
+    // so this only reports and never trims.
+    std::unique_ptr<lsp::MemoryBudget::Consumer> memory = lsp::MemoryBudget::Global().Register("working_files");
+
+    void TrackResize(size_t before, size_t after)
+    {
+        memory->Add(static_cast<int64_t>(after) - static_cast<int64_t>(before));
+    }
 };
 
 WorkingFile::WorkingFile(WorkingFiles& _parent, const AbsolutePath& filename,
@@ -21,7 +95,7 @@ WorkingFile::WorkingFile(WorkingFiles& _parent, const AbsolutePath& filename,
 
 WorkingFile::WorkingFile(WorkingFiles& _parent, const AbsolutePath& filename,
                          std::string&& buffer_content)
-  : filename(filename), directory(filename), parent(_parent), counter(0), buffer_content(buffer_content)
+  : filename(filename), directory(filename), parent(_parent), counter(0), buffer_content(std::move(buffer_content))
 {
     directory = Directory(GetDirName(filename.path));
 }
@@ -40,22 +114,28 @@ WorkingFiles::~WorkingFiles()
 
 void WorkingFiles::CloseFilesInDirectory(const std::vector<Directory>& directories)
 {
-    std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
-    std::vector<AbsolutePath> files_to_be_delete;
-
-    for(auto& it : d_ptr->files)
+    std::vector<uint32_t> files_to_be_delete;
     {
+        std::lock_guard<std::mutex> lock(d_ptr->directories_mutex);
         for (auto& dir : directories)
         {
-            if (it.second->directory == dir) {
-                files_to_be_delete.emplace_back(it.first);
-            }
+            const auto findIt = d_ptr->directories.find(dir.path);
+            if (findIt == d_ptr->directories.end())
+                continue;
+            files_to_be_delete.insert(files_to_be_delete.end(), findIt->second.begin(), findIt->second.end());
+            d_ptr->directories.erase(findIt);
         }
     }
 
-    for(auto& it : files_to_be_delete)
+    for(auto id : files_to_be_delete)
     {
-        d_ptr->files.erase(it);
+        auto& shard = d_ptr->ShardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto findIt = shard.files.find(id);
+        if (findIt == shard.files.end())
+            continue;
+        d_ptr->TrackResize(findIt->second->buffer_content.size(), 0);
+        shard.files.erase(findIt);
     }
 }
 
@@ -63,48 +143,61 @@ void WorkingFiles::CloseFilesInDirectory(const std::vector<Directory>& directori
 
 
 std::shared_ptr<WorkingFile> WorkingFiles::GetFileByFilename(const AbsolutePath& filename) {
-  std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
-  return GetFileByFilenameNoLock(filename);
-}
-
-std::shared_ptr<WorkingFile> WorkingFiles::GetFileByFilenameNoLock(
-    const AbsolutePath& filename) {
-    const auto findIt = d_ptr->files.find(filename);
-    if ( findIt != d_ptr->files.end())
-    {
-        return findIt->second;
-    }
+  const uint32_t id = d_ptr->uris.FindPath(filename.path);
+  if (id == lsp::UriTable::kInvalidId)
+    return nullptr;
+  auto& shard = d_ptr->ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const auto findIt = shard.files.find(id);
+  if (findIt != shard.files.end())
+  {
+      return findIt->second;
+  }
   return nullptr;
 }
 
 
 
 std::shared_ptr<WorkingFile>  WorkingFiles::OnOpen( lsTextDocumentItem& open) {
-  std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
-
-  AbsolutePath filename = open.uri.GetAbsolutePath();
+  const auto uri_id = d_ptr->uris.Intern(open.uri);
+  const AbsolutePath& filename = d_ptr->uris.Path(uri_id);
+  const uint32_t id = d_ptr->uris.PathIdOf(uri_id);
+  auto& shard = d_ptr->ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.mutex);
 
   // The file may already be open.
-  if (auto file = GetFileByFilenameNoLock(filename)) {
+  const auto findIt = shard.files.find(id);
+  if (findIt != shard.files.end()) {
+    auto& file = findIt->second;
     file->version = open.version;
+    d_ptr->TrackResize(file->buffer_content.size(), open.text.size());
     file->buffer_content.swap(open.text);
 
     return file;
   }
 
-  const auto& it =  d_ptr->files.insert({ filename,std::make_shared<WorkingFile>(*this,filename, std::move(open.text)) });
-  return  it.first->second;
+  d_ptr->TrackResize(0, open.text.size());
+  auto file = std::make_shared<WorkingFile>(*this, filename, std::move(open.text));
+  file->path_id = id;
+  shard.files.emplace(id, file);
+  d_ptr->AddToDirectory(*file);
+  return  file;
 }
 
 
 std::shared_ptr<WorkingFile>  WorkingFiles::OnChange(const lsTextDocumentDidChangeParams& change) {
-  std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
+  const uint32_t id = d_ptr->FindOpen(change.textDocument.uri);
+  if (id == lsp::UriTable::kInvalidId)
+    return {};
+  auto& shard = d_ptr->ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.mutex);
 
-  AbsolutePath filename = change.textDocument.uri.GetAbsolutePath();
-  auto file = GetFileByFilenameNoLock(filename);
-  if (!file) {
+  const auto findIt = shard.files.find(id);
+  if (findIt == shard.files.end()) {
     return {};
   }
+  auto file = findIt->second;
+  const size_t size_before = file->buffer_content.size();
 
   if (change.textDocument.version)
     file->version = *change.textDocument.version;
@@ -128,17 +221,23 @@ std::shared_ptr<WorkingFile>  WorkingFiles::OnChange(const lsTextDocumentDidChan
 
     }
   }
+  d_ptr->TrackResize(size_before, file->buffer_content.size());
   return  file;
 }
 
 bool WorkingFiles::OnClose(const lsTextDocumentIdentifier& close) {
-  std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
-
-  AbsolutePath filename = close.uri.GetAbsolutePath();
-  const auto findIt = d_ptr->files.find(filename);
-  if( findIt != d_ptr->files.end())
+  const uint32_t id = d_ptr->FindOpen(close.uri);
+  if (id == lsp::UriTable::kInvalidId)
+    return false;
+  auto& shard = d_ptr->ShardFor(id);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  const auto findIt = shard.files.find(id);
+  if( findIt != shard.files.end())
   {
-      d_ptr->files.erase(findIt);
+      d_ptr->RemoveFromDirectory(*findIt->second);
+      d_ptr->TrackResize(findIt->second->buffer_content.size(), 0);
+      shard.files.erase(findIt);
           return true;
   }
   return false;
@@ -146,25 +245,58 @@ bool WorkingFiles::OnClose(const lsTextDocumentIdentifier& close) {
 
 std::shared_ptr<WorkingFile> WorkingFiles::OnSave(const lsTextDocumentIdentifier& _save)
 {
-    std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
+    std::shared_ptr<WorkingFile> file;
+    Save(_save, file).get();
+    return file;
+}
 
-    AbsolutePath filename = _save.uri.GetAbsolutePath();
-    const auto findIt = d_ptr->files.find(filename);
-    if (findIt != d_ptr->files.end())
+lsp::future<bool> WorkingFiles::OnSaveAsync(const lsTextDocumentIdentifier& _save)
+{
+    std::shared_ptr<WorkingFile> file;
+    return Save(_save, file);
+}
+
+lsp::future<bool> WorkingFiles::Save(const lsTextDocumentIdentifier& _save, std::shared_ptr<WorkingFile>& file)
+{
+    std::string snapshot;
+    const uint32_t id = d_ptr->FindOpen(_save.uri);
+    if (id != lsp::UriTable::kInvalidId)
     {
-        std::shared_ptr<WorkingFile>& file = findIt->second;
-        lsp::WriteToFile(file->filename, file->GetContentNoLock());
-        return findIt->second;
+        auto& shard = d_ptr->ShardFor(id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto findIt = shard.files.find(id);
+        if (findIt != shard.files.end())
+        {
+            file = findIt->second;
+            snapshot = file->GetContentNoLock();
+        }
     }
-    return  {};
+    if (!file)
+    {
+        lsp::promise<bool> not_open;
+        not_open.set_value(false);
+        return not_open.get_future();
+    }
+    // The write happens on the writer thread, outside of any shard lock.
+    return d_ptr->writer.Write(file->filename.path, std::move(snapshot));
+}
 
+void WorkingFiles::SetFsyncPolicy(lsp::FsyncPolicy policy)
+{
+    d_ptr->writer.SetFsyncPolicy(policy);
+}
+
+void WorkingFiles::FlushSaves()
+{
+    d_ptr->writer.Flush();
 }
 
 bool WorkingFiles::GetFileBufferContent(std::shared_ptr<WorkingFile>&file, std::string& out)
 {
-    std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
     if (file)
     {
+        auto& shard = d_ptr->ShardFor(file->path_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
         out = file->buffer_content;
         return  true;
     }
@@ -172,15 +304,23 @@ bool WorkingFiles::GetFileBufferContent(std::shared_ptr<WorkingFile>&file, std::
 }
 bool WorkingFiles::GetFileBufferContent(std::shared_ptr<WorkingFile>& file, std::wstring& out)
 {
-    std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
     if (file)
     {
+        auto& shard = d_ptr->ShardFor(file->path_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
         out = lsp::s2ws(file->buffer_content);
         return  true;
     }
     return  false;
 }
 void  WorkingFiles::Clear() {
-    std::lock_guard<std::mutex> lock(d_ptr->files_mutex);
-    d_ptr->files.clear();
+    for (auto& shard : d_ptr->shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& it : shard.files)
+            d_ptr->TrackResize(it.second->buffer_content.size(), 0);
+        shard.files.clear();
+    }
+    std::lock_guard<std::mutex> lock(d_ptr->directories_mutex);
+    d_ptr->directories.clear();
 }